@@ -0,0 +1,1767 @@
+// Detection module: OpenCV figure detection, Tesseract verification, the
+// in-memory page store and the cross-run duplicate index. Built as
+// docimg_cv.so and loaded by the application on the first run that enables
+// OpenCV (see load_cv_engine in main.cpp), so that OpenCV, Tesseract and
+// Leptonica are only mapped into processes that use them.
+//
+// Build: g++ -std=c++17 -O2 -shared -fPIC cv_engine.cpp -o docimg_cv.so
+//            `pkg-config --cflags --libs opencv4` -ltesseract -llept -lzstd -lrt -pthread
+#include "docimg.h"
+#include <sstream>
+#include <cstring>
+#include <fstream>
+#include <cmath>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "figure_ring.h"
+
+// Prevent X11 Status conflict
+#define Status Status_
+#include <opencv2/opencv.hpp>
+#undef Status
+
+// Tesseract Includes
+#include <tesseract/baseapi.h>
+#include <leptonica/allheaders.h>
+
+// Page Store Compression
+#include <zstd.h>
+
+thread_local long long t_ocr_ns = 0; // This thread's share of g_ocr_ns
+
+// ==========================================
+// OpenCV & Tesseract Logic
+// ==========================================
+
+struct FigureCandidate {
+    cv::Rect bbox;
+    double textDensity;
+    double area;
+};
+
+// Pages are detected in the pixel format they were stored in, so 1-bit scans
+// are not expanded to BGR only to be converted back. Each format supplies
+// its own grayscale view and binarisation; the pipeline below is compiled
+// once per format with only the conversions that format needs.
+enum class PixelFormat { Bilevel, Gray, BGR };
+
+// Sauvola binarisation in one pass over the image: a pixel is ink when it is
+// darker than mean * (1 + k * (stddev / R - 1)) of the window around it.
+// Window sums come from running per-column sums over the window's rows and a
+// prefix sum across them (an integral image one band high), so the cost per
+// pixel does not depend on the window size, unlike a Gaussian-weighted
+// adaptive threshold, and only a few rows of sums are kept.
+const int SAUVOLA_WINDOW = 25;
+const double SAUVOLA_K = 0.34;
+const double SAUVOLA_R = 128.0;
+
+static void sauvolaBinarizeInv(const cv::Mat& gray, cv::Mat& binary, int window) {
+    int rows = gray.rows, cols = gray.cols, half = window / 2;
+    binary.create(rows, cols, CV_8UC1);
+
+    std::vector<int> colSum(cols, 0);
+    std::vector<long long> colSq(cols, 0);
+    std::vector<long long> prefix(cols + 1, 0), prefixSq(cols + 1, 0);
+    int top = 0, bottom = -1; // Rows currently in colSum
+
+    for (int y = 0; y < rows; y++) {
+        int wantBottom = std::min(rows - 1, y + half);
+        while (bottom < wantBottom) {
+            const uchar* row = gray.ptr<uchar>(++bottom);
+            for (int x = 0; x < cols; x++) {
+                colSum[x] += row[x];
+                colSq[x] += row[x] * row[x];
+            }
+        }
+        for (; top < y - half; top++) {
+            const uchar* row = gray.ptr<uchar>(top);
+            for (int x = 0; x < cols; x++) {
+                colSum[x] -= row[x];
+                colSq[x] -= row[x] * row[x];
+            }
+        }
+        for (int x = 0; x < cols; x++) {
+            prefix[x + 1] = prefix[x] + colSum[x];
+            prefixSq[x + 1] = prefixSq[x] + colSq[x];
+        }
+
+        int height = bottom - top + 1;
+        const uchar* src = gray.ptr<uchar>(y);
+        uchar* dst = binary.ptr<uchar>(y);
+        for (int x = 0; x < cols; x++) {
+            int left = std::max(0, x - half), right = std::min(cols - 1, x + half);
+            double n = (double)(right - left + 1) * height;
+            double mean = (prefix[right + 1] - prefix[left]) / n;
+            double var = (prefixSq[right + 1] - prefixSq[left]) / n - mean * mean;
+            double threshold = mean * (1.0 + SAUVOLA_K * (std::sqrt(std::max(var, 0.0)) / SAUVOLA_R - 1.0));
+            dst[x] = src[x] <= threshold ? 255 : 0;
+        }
+    }
+}
+
+// Gaussian adaptive threshold or Sauvola, whichever the run selected; C only
+// applies to the former
+static void localBinarizeInv(const cv::Mat& gray, cv::Mat& binary, int blockSize, double C) {
+    if (g_binarizer == Binarizer::Sauvola) {
+        sauvolaBinarizeInv(gray, binary, blockSize);
+        return;
+    }
+    cv::adaptiveThreshold(gray, binary, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY_INV, blockSize, C);
+}
+
+template<PixelFormat F> struct PixelTraits;
+
+template<> struct PixelTraits<PixelFormat::BGR> {
+    static void toGray(const cv::Mat& src, cv::Mat& gray) {
+        cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+    }
+    static void binarizeInv(const cv::Mat& gray, cv::Mat& binary, int blockSize, double C) {
+        localBinarizeInv(gray, binary, blockSize, C);
+    }
+};
+
+template<> struct PixelTraits<PixelFormat::Gray> {
+    static void toGray(const cv::Mat& src, cv::Mat& gray) {
+        gray = src;
+    }
+    static void binarizeInv(const cv::Mat& gray, cv::Mat& binary, int blockSize, double C) {
+        localBinarizeInv(gray, binary, blockSize, C);
+    }
+};
+
+// Already black/white: inverting is all the thresholding needed
+template<> struct PixelTraits<PixelFormat::Bilevel> {
+    static void toGray(const cv::Mat& src, cv::Mat& gray) {
+        gray = src;
+    }
+    static void binarizeInv(const cv::Mat& gray, cv::Mat& binary, int, double) {
+        cv::threshold(gray, binary, 127, 255, cv::THRESH_BINARY_INV);
+    }
+};
+
+// Normalise a page loaded with IMREAD_UNCHANGED to 8-bit and report its format
+PixelFormat classify_pixel_format(cv::Mat& image) {
+    if (image.depth() != CV_8U) {
+        image.convertTo(image, CV_8U, image.depth() == CV_16U ? 1.0 / 256.0 : 1.0);
+    }
+    if (image.channels() == 4) {
+        cv::cvtColor(image, image, cv::COLOR_BGRA2BGR);
+    }
+    if (image.channels() == 3) return PixelFormat::BGR;
+
+    for (int y = 0; y < image.rows; y++) {
+        const uchar* row = image.ptr<uchar>(y);
+        for (int x = 0; x < image.cols; x++) {
+            if (row[x] != 0 && row[x] != 255) return PixelFormat::Gray;
+        }
+    }
+    return PixelFormat::Bilevel;
+}
+
+// pageBinary: the region's crop of a binarised page, when the page has one
+template<PixelFormat F>
+double calculateTextDensity(const cv::Mat& region, const cv::Mat& pageBinary = cv::Mat()) {
+    cv::Mat gray, binary;
+    if (pageBinary.empty()) {
+        PixelTraits<F>::toGray(region, gray);
+        PixelTraits<F>::binarizeInv(gray, binary, 15, 10);
+    }
+    
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+    cv::morphologyEx(pageBinary.empty() ? binary : pageBinary, binary, cv::MORPH_CLOSE, kernel);
+    
+    cv::Mat labels, stats, centroids;
+    int numComponents = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8);
+    
+    int textLikeComponents = 0;
+    for (int i = 1; i < numComponents; i++) {
+        int width = stats.at<int>(i, cv::CC_STAT_WIDTH);
+        int height = stats.at<int>(i, cv::CC_STAT_HEIGHT);
+        int area = stats.at<int>(i, cv::CC_STAT_AREA);
+        
+        if (height > 5 && height < 50 && width > 3 && width < 200) {
+            double aspectRatio = (double)width / height;
+            if (aspectRatio > 0.2 && aspectRatio < 10 && area > 20) {
+                textLikeComponents++;
+            }
+        }
+    }
+    
+    return (double)textLikeComponents / (region.rows * region.cols) * 10000;
+}
+
+template<PixelFormat F>
+bool hasGraphicalContent(const cv::Mat& region) {
+    cv::Mat gray, edges;
+    PixelTraits<F>::toGray(region, gray);
+    
+    cv::Canny(gray, edges, 50, 150);
+    int edgePixels = cv::countNonZero(edges);
+    double edgeDensity = (double)edgePixels / (region.rows * region.cols);
+    
+    return edgeDensity > 0.005 && edgeDensity < 0.15;
+}
+
+int countWords(const std::string& text) {
+    std::stringstream ss(text);
+    std::string word;
+    int count = 0;
+    while (ss >> word) count++;
+    return count;
+}
+
+// Recognise the image or rectangle last given to tess and decide whether
+// it is body text; ocr_start is when setting it up began
+static bool recognizedAsText(tesseract::TessBaseAPI* tess, std::chrono::steady_clock::time_point ocr_start,
+                             std::string& extractedTextOut) {
+    int conf = tess->MeanTextConf();
+    char* text = tess->GetUTF8Text();
+    std::string strText(text);
+    delete[] text;
+
+    long long ocr_ns = elapsed_ns(ocr_start);
+    t_ocr_ns += ocr_ns;
+    count_cost(g_ocr_ns, &DocCosts::ocr_ns, ocr_ns);
+    count_cost(g_ocr_calls, &DocCosts::ocr_calls);
+
+    extractedTextOut = strText;
+    int wordCount = countWords(strText);
+    
+    if (conf > 70 && wordCount > 25) {
+        return true;
+    }
+    
+    return false;
+}
+
+template<PixelFormat F>
+bool isTextBlock(tesseract::TessBaseAPI* tess, const cv::Mat& region, std::string& extractedTextOut) {
+    if (!tess) return false;
+
+    cv::Mat gray;
+    PixelTraits<F>::toGray(region, gray);
+
+    auto ocr_start = std::chrono::steady_clock::now();
+    tess->SetImage(gray.data, gray.cols, gray.rows, 1, gray.step);
+    return recognizedAsText(tess, ocr_start, extractedTextOut);
+}
+
+// ==========================================
+// Leptonica Page Bridge
+// ==========================================
+// Tesseract copies whatever SetImage gets into a Pix of its own, so handing
+// it each candidate region meant a grayscale copy per region on our side
+// and a conversion per region on its side. Instead the page goes to
+// Tesseract once, as an 8 bpp Pix, and each candidate is selected with
+// SetRectangle, which needs no allocation or copy here. The Pix cannot
+// alias the cv::Mat rows: Leptonica keeps bytes big-endian within 32-bit
+// words, so on little-endian hosts the page is byte-swapped once while it
+// is built.
+
+// Set the page whose candidates the next isTextBlockInPage calls OCR. False
+// only when Leptonica cannot allocate the page; callers then OCR each
+// candidate region on its own (isTextBlock)
+static bool setOcrPage(tesseract::TessBaseAPI* tess, const cv::Mat& gray) {
+    auto ocr_start = std::chrono::steady_clock::now();
+    Pix* pix = pixCreate(gray.cols, gray.rows, 8);
+    if (!pix) {
+        std::cerr << "[ocr] cannot allocate a " << gray.cols << "x" << gray.rows
+                  << " page for Tesseract, recognising its candidates one at a time" << std::endl;
+        return false;
+    }
+    l_uint32* data = pixGetData(pix);
+    int wpl = pixGetWpl(pix);
+    for (int y = 0; y < gray.rows; y++) {
+        memcpy(data + (size_t)y * wpl, gray.ptr<uchar>(y), gray.cols);
+    }
+    pixEndianByteSwap(pix);
+    tess->SetImage(pix); // Tesseract keeps its own copy
+    pixDestroy(&pix);
+
+    long long ocr_ns = elapsed_ns(ocr_start);
+    t_ocr_ns += ocr_ns;
+    count_cost(g_ocr_ns, &DocCosts::ocr_ns, ocr_ns);
+    return true;
+}
+
+static bool isTextBlockInPage(tesseract::TessBaseAPI* tess, const cv::Rect& box, std::string& extractedTextOut) {
+    auto ocr_start = std::chrono::steady_clock::now();
+    tess->SetRectangle(box.x, box.y, box.width, box.height);
+    return recognizedAsText(tess, ocr_start, extractedTextOut);
+}
+
+bool isLikelyPureTextCV(double textDensity) {
+    if (textDensity > 10.0) return true; 
+    return false;
+}
+
+// ==========================================
+// Candidate Generation (Layout Engines)
+// ==========================================
+
+// Full-resolution threshold + dilation + contour bounding boxes
+template<PixelFormat F>
+std::vector<cv::Rect> findCandidateRegionsContours(const cv::Mat& image, const cv::Mat& pageBinary = cv::Mat()) {
+    cv::Mat gray, binary;
+    if (pageBinary.empty()) {
+        PixelTraits<F>::toGray(image, gray);
+        PixelTraits<F>::binarizeInv(gray, binary, 25, 15);
+    }
+    
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+    cv::dilate(pageBinary.empty() ? binary : pageBinary, binary, kernel, cv::Point(-1, -1), 3);
+    
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    std::vector<cv::Rect> boxes;
+    for (const auto& contour : contours) {
+        boxes.push_back(cv::boundingRect(contour));
+    }
+    return boxes;
+}
+
+// Recursive XY-cut on a downsampled binary page: trim each block to its ink,
+// then split it at the widest empty row or column band until no band is at
+// least minGap wide. Gaps match what the 3x 5x5 dilation of the contour
+// engine bridges, so both engines group text and figures alike.
+const int XYCUT_SCALE = 4;
+const int XYCUT_MIN_GAP_PX = 30; // At full resolution
+const int XYCUT_MAX_DEPTH = 32;
+
+static void widestZeroRun(const cv::Mat& profile, int& start, int& length) {
+    start = 0;
+    length = 0;
+    int run = 0;
+    int n = (int)profile.total();
+    for (int i = 0; i < n; i++) {
+        if (profile.at<int>(i) == 0) {
+            run++;
+            if (run > length) {
+                length = run;
+                start = i - run + 1;
+            }
+        } else {
+            run = 0;
+        }
+    }
+}
+
+static void xyCut(const cv::Mat& binary, cv::Rect r, int minGap, int depth, std::vector<cv::Rect>& out) {
+    cv::Mat rows, cols;
+    cv::reduce(binary(r), rows, 1, cv::REDUCE_SUM, CV_32S);
+    cv::reduce(binary(r), cols, 0, cv::REDUCE_SUM, CV_32S);
+
+    // Trim empty margins
+    int top = 0, bottom = r.height - 1, left = 0, right = r.width - 1;
+    while (top <= bottom && rows.at<int>(top) == 0) top++;
+    if (top > bottom) return;
+    while (rows.at<int>(bottom) == 0) bottom--;
+    while (cols.at<int>(left) == 0) left++;
+    while (cols.at<int>(right) == 0) right--;
+
+    cv::Rect block(r.x + left, r.y + top, right - left + 1, bottom - top + 1);
+    rows = rows.rowRange(top, bottom + 1);
+    cols = cols.colRange(left, right + 1);
+
+    int rowGap, rowGapLen, colGap, colGapLen;
+    widestZeroRun(rows, rowGap, rowGapLen);
+    widestZeroRun(cols, colGap, colGapLen);
+
+    if (depth >= XYCUT_MAX_DEPTH || std::max(rowGapLen, colGapLen) < minGap) {
+        out.push_back(block);
+        return;
+    }
+
+    if (rowGapLen >= colGapLen) {
+        xyCut(binary, cv::Rect(block.x, block.y, block.width, rowGap), minGap, depth + 1, out);
+        int below = rowGap + rowGapLen;
+        xyCut(binary, cv::Rect(block.x, block.y + below, block.width, block.height - below), minGap, depth + 1, out);
+    } else {
+        xyCut(binary, cv::Rect(block.x, block.y, colGap, block.height), minGap, depth + 1, out);
+        int after = colGap + colGapLen;
+        xyCut(binary, cv::Rect(block.x + after, block.y, block.width - after, block.height), minGap, depth + 1, out);
+    }
+}
+
+template<PixelFormat F>
+std::vector<cv::Rect> findCandidateRegionsXYCut(const cv::Mat& image) {
+    cv::Mat gray, small, binary;
+    PixelTraits<F>::toGray(image, gray);
+    cv::resize(gray, small, cv::Size(std::max(1, image.cols / XYCUT_SCALE), std::max(1, image.rows / XYCUT_SCALE)),
+               0, 0, cv::INTER_AREA);
+    cv::threshold(small, binary, 0, 1, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+    std::vector<cv::Rect> blocks;
+    int minGap = std::max(1, XYCUT_MIN_GAP_PX / XYCUT_SCALE);
+    xyCut(binary, cv::Rect(0, 0, binary.cols, binary.rows), minGap, 0, blocks);
+
+    cv::Rect page(0, 0, image.cols, image.rows);
+    std::vector<cv::Rect> boxes;
+    for (const auto& b : blocks) {
+        boxes.push_back(cv::Rect(b.x * XYCUT_SCALE, b.y * XYCUT_SCALE, b.width * XYCUT_SCALE, b.height * XYCUT_SCALE) & page);
+    }
+    return boxes;
+}
+
+// deferred: when set, candidates that would need OCR are collected here
+// instead of being OCR'd, so the clear-cut figures can be emitted right away
+template<PixelFormat F>
+std::vector<cv::Rect> extractFigures(const cv::Mat& image, tesseract::TessBaseAPI* tess, bool useOCR,
+                                     std::vector<cv::Rect>* deferred = nullptr) {
+    std::vector<cv::Rect> figures;
+
+    // Sauvola costs the same for any window, so the page is binarised once
+    // and candidates reuse crops of it instead of thresholding each region
+    cv::Mat pageGray, pageBinary;
+    if (g_binarizer == Binarizer::Sauvola) {
+        PixelTraits<F>::toGray(image, pageGray);
+        PixelTraits<F>::binarizeInv(pageGray, pageBinary, SAUVOLA_WINDOW, 0);
+    }
+    int ocrPage = 0; // 1 once the page is set in tess, -1 if that failed
+    
+    std::vector<cv::Rect> regions = (g_layout_engine == LayoutEngine::XYCut)
+        ? findCandidateRegionsXYCut<F>(image)
+        : findCandidateRegionsContours<F>(image, pageBinary);
+    count_cost(g_candidates, &DocCosts::candidates, (long long)regions.size());
+
+    std::vector<FigureCandidate> candidates;
+    
+    double minArea = image.rows * image.cols * 0.01;
+    double maxArea = image.rows * image.cols * 0.7;
+    
+    for (const auto& bbox : regions) {
+        double area = bbox.width * bbox.height;
+        
+        if (area < minArea || area > maxArea) continue;
+        if (bbox.width < 100 || bbox.height < 100) continue;
+        
+        int padX = (int)(bbox.width * 0.05);
+        int padY = (int)(bbox.height * 0.05);
+
+        int x = bbox.x - padX;
+        int y = bbox.y - padY;
+
+        if (x < 0) x = 0;
+        if (y < 0) y = 0;
+
+        int width = bbox.width + 2 * padX;
+        int height = bbox.height + 2 * padY;
+
+        if (x + width > image.cols) width = image.cols - x;
+        if (y + height > image.rows) height = image.rows - y;
+        
+        cv::Rect paddedBox(x, y, width, height);
+        cv::Mat region = image(paddedBox);
+        double textDensity = calculateTextDensity<F>(region, pageBinary.empty() ? cv::Mat() : pageBinary(paddedBox));
+        
+        candidates.push_back({paddedBox, textDensity, area});
+    }
+    
+    std::sort(candidates.begin(), candidates.end(),
+         [](const FigureCandidate& a, const FigureCandidate& b) {
+             return a.area > b.area;
+         });
+    
+    for (const auto& candidate : candidates) {
+        cv::Mat region = image(candidate.bbox);
+        bool hasGraphics = hasGraphicalContent<F>(region);
+        
+        if (candidate.textDensity > 20.0) {
+            if (hasGraphics) {
+                figures.push_back(candidate.bbox);
+            }
+            continue;
+        }
+
+        if (candidate.textDensity < 2.0) {
+            figures.push_back(candidate.bbox);
+            continue;
+        }
+
+        if (isLikelyPureTextCV(candidate.textDensity)) {
+            continue; 
+        }
+
+        if (deferred) {
+            if (hasGraphics) deferred->push_back(candidate.bbox);
+            continue;
+        }
+
+        std::string ocrTextResult = "";
+        bool isTextBlockByOCR = false;
+        
+        if (useOCR && tess) {
+            if (ocrPage == 0) {
+                if (pageGray.empty()) PixelTraits<F>::toGray(image, pageGray);
+                ocrPage = setOcrPage(tess, pageGray) ? 1 : -1;
+            }
+            isTextBlockByOCR = (ocrPage > 0) ? isTextBlockInPage(tess, candidate.bbox, ocrTextResult)
+                                             : isTextBlock<F>(tess, region, ocrTextResult);
+        }
+
+        if (isTextBlockByOCR) {
+            continue; 
+        }
+        
+        if (hasGraphics) {
+            figures.push_back(candidate.bbox);
+        }
+    }
+    
+    return figures;
+}
+
+std::vector<cv::Rect> extractFigures(const cv::Mat& image, PixelFormat format, tesseract::TessBaseAPI* tess, bool useOCR,
+                                     std::vector<cv::Rect>* deferred = nullptr) {
+    switch (format) {
+        case PixelFormat::Bilevel: return extractFigures<PixelFormat::Bilevel>(image, tess, useOCR, deferred);
+        case PixelFormat::Gray:    return extractFigures<PixelFormat::Gray>(image, tess, useOCR, deferred);
+        default:                   return extractFigures<PixelFormat::BGR>(image, tess, useOCR, deferred);
+    }
+}
+
+// A placed Form XObject gets the tests a detected candidate gets, short of
+// OCR; forms that read as text (letterheads, ruled tables) stay on the page
+template<PixelFormat F>
+bool isFigureForm(const cv::Mat& region) {
+    double textDensity = calculateTextDensity<F>(region);
+    if (textDensity < 2.0) return true;
+    if (textDensity <= 20.0 && isLikelyPureTextCV(textDensity)) return false;
+    return hasGraphicalContent<F>(region);
+}
+
+bool isFigureForm(const cv::Mat& region, PixelFormat format) {
+    switch (format) {
+        case PixelFormat::Bilevel: return isFigureForm<PixelFormat::Bilevel>(region);
+        case PixelFormat::Gray:    return isFigureForm<PixelFormat::Gray>(region);
+        default:                   return isFigureForm<PixelFormat::BGR>(region);
+    }
+}
+
+void toGray(const cv::Mat& image, PixelFormat format, cv::Mat& gray) {
+    switch (format) {
+        case PixelFormat::Bilevel: PixelTraits<PixelFormat::Bilevel>::toGray(image, gray); break;
+        case PixelFormat::Gray:    PixelTraits<PixelFormat::Gray>::toGray(image, gray); break;
+        default:                   PixelTraits<PixelFormat::BGR>::toGray(image, gray); break;
+    }
+}
+
+bool isTextBlock(tesseract::TessBaseAPI* tess, const cv::Mat& region, PixelFormat format, std::string& extractedTextOut) {
+    switch (format) {
+        case PixelFormat::Bilevel: return isTextBlock<PixelFormat::Bilevel>(tess, region, extractedTextOut);
+        case PixelFormat::Gray:    return isTextBlock<PixelFormat::Gray>(tess, region, extractedTextOut);
+        default:                   return isTextBlock<PixelFormat::BGR>(tess, region, extractedTextOut);
+    }
+}
+
+// Write the page region as a clipped SVG straight from the PDF (no rasterising).
+// pdftocairo takes the crop box in points for vector output.
+bool write_vector_figure(const std::string& pdf_path, int page, const cv::Rect& box, const std::string& output_path) {
+    double scale = 72.0 / PDF_RENDER_DPI;
+    std::string cmd = "pdftocairo -svg -f " + std::to_string(page) + " -l " + std::to_string(page) +
+                      " -x " + std::to_string((int)std::floor(box.x * scale)) +
+                      " -y " + std::to_string((int)std::floor(box.y * scale)) +
+                      " -W " + std::to_string((int)std::ceil(box.width * scale)) +
+                      " -H " + std::to_string((int)std::ceil(box.height * scale)) +
+                      " '" + pdf_path + "' '" + output_path + "' > /dev/null 2>&1";
+    return run_command(cmd.c_str()) == 0;
+}
+
+// ==========================================
+// Figure Ring (Shared-Memory Output)
+// ==========================================
+// With DOCIMG_FIGURE_RING=<name> set (a POSIX shared-memory name such as
+// /docimg_figures), raster figures are published into a ring in that object
+// (layout in figure_ring.h) instead of being encoded as PNG, so a consumer
+// process reads the pixels in place. While no consumer is attached, or for a
+// figure larger than the whole ring, the PNG is written as before. The ring
+// is DOCIMG_FIGURE_RING_MB large when this process creates it.
+
+const size_t FIGURE_RING_DEFAULT_MB = 256;
+const int FIGURE_RING_POLL_MS = 100; // Consumer liveness re-check while the ring is full
+
+class FigureRing {
+public:
+    // nullptr when not configured or the object cannot be mapped
+    static FigureRing* instance() {
+        static FigureRing* ring = open_from_env();
+        return ring;
+    }
+
+    // Blocks while the ring is full and the consumer is alive; false when
+    // the figure was not published and has to be written to disk instead
+    bool publish(const cv::Mat& pixels, const cv::Rect& box, int page, const std::string& name) {
+        size_t step = pixels.cols * pixels.elemSize();
+        size_t need = figure_ring_align(sizeof(FigureRecord) + step * pixels.rows);
+        if (pixels.depth() != CV_8U || need > capacity_) return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!consumer_alive()) return false;
+
+        // A figure that does not fit before the end of the ring goes at 0. The
+        // PAD record closing off the end is published on its own first, so the
+        // figure only ever waits for its own size (pad + figure can exceed the
+        // whole ring)
+        uint64_t head = header_->head.load(std::memory_order_relaxed);
+        size_t pos = head % capacity_;
+        if (capacity_ - pos < need) {
+            size_t pad = capacity_ - pos;
+            if (!wait_for_space(head, pad)) return false;
+            FigureRecord* filler = (FigureRecord*)(data_ + pos);
+            filler->size = (uint32_t)pad;
+            filler->kind = FIGURE_RECORD_PAD;
+            head += pad;
+            pos = 0;
+            header_->head.store(head, std::memory_order_release);
+            figure_ring_wake(header_->head_seq);
+        }
+        if (!wait_for_space(head, need)) return false;
+
+        FigureRecord* rec = (FigureRecord*)(data_ + pos);
+        rec->size = (uint32_t)need;
+        rec->kind = FIGURE_RECORD;
+        rec->page = page;
+        rec->x = box.x;
+        rec->y = box.y;
+        rec->width = box.width;
+        rec->height = box.height;
+        rec->rows = pixels.rows;
+        rec->cols = pixels.cols;
+        rec->channels = pixels.channels();
+        rec->step = (uint32_t)step;
+        snprintf(rec->name, sizeof(rec->name), "%s", name.c_str());
+
+        cv::Mat target(pixels.rows, pixels.cols, pixels.type(), (unsigned char*)(rec + 1), step);
+        pixels.copyTo(target);
+
+        header_->head.store(head + need, std::memory_order_release);
+        figure_ring_wake(header_->head_seq);
+        return true;
+    }
+
+private:
+    FigureRingHeader* header_ = nullptr;
+    unsigned char* data_ = nullptr;
+    size_t capacity_ = 0;
+    std::mutex mutex_; // One producer: serialises the detection threads
+
+    bool consumer_alive() const {
+        pid_t pid = header_->consumer_pid.load(std::memory_order_acquire);
+        return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+    }
+
+    // Wait until bytes are free after head; false if the consumer went away
+    bool wait_for_space(uint64_t head, size_t bytes) {
+        while (true) {
+            uint32_t seen = header_->tail_seq.load(std::memory_order_acquire);
+            uint64_t used = head - header_->tail.load(std::memory_order_acquire);
+            if (capacity_ - used >= bytes) return true;
+            if (!consumer_alive()) return false;
+            figure_ring_wait(header_->tail_seq, seen, FIGURE_RING_POLL_MS);
+        }
+    }
+
+    static FigureRing* open_from_env() {
+        const char* name = getenv("DOCIMG_FIGURE_RING");
+        if (!name || !*name) return nullptr;
+        const char* env_mb = getenv("DOCIMG_FIGURE_RING_MB");
+        size_t mb = (env_mb && atol(env_mb) > 0) ? (size_t)atol(env_mb) : FIGURE_RING_DEFAULT_MB;
+        mb = std::min(mb, (size_t)4095); // Record sizes (a PAD can span the ring) are 32-bit
+
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+        if (fd < 0) {
+            std::cerr << "[ring] cannot open " << name << ": " << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        // An existing ring keeps its size, so an attached consumer's mapping stays valid
+        struct stat st;
+        size_t total = FIGURE_RING_HEADER_BYTES + (mb << 20);
+        bool fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+        if (!fresh) total = (size_t)st.st_size;
+        if ((fresh && ftruncate(fd, total) != 0) || total <= FIGURE_RING_HEADER_BYTES) {
+            close(fd);
+            return nullptr;
+        }
+        void* mem = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mem == MAP_FAILED) return nullptr;
+
+        FigureRing* ring = new FigureRing();
+        ring->header_ = (FigureRingHeader*)mem;
+        ring->data_ = (unsigned char*)mem + FIGURE_RING_HEADER_BYTES;
+        ring->capacity_ = (total - FIGURE_RING_HEADER_BYTES) & ~(FIGURE_RING_ALIGN - 1);
+
+        FigureRingHeader* h = ring->header_;
+        if (h->magic != FIGURE_RING_MAGIC || h->version != FIGURE_RING_VERSION || h->capacity != ring->capacity_) {
+            h->version = FIGURE_RING_VERSION;
+            h->capacity = ring->capacity_;
+            h->head = 0;
+            h->tail = 0;
+            std::atomic_thread_fence(std::memory_order_release);
+            h->magic = FIGURE_RING_MAGIC; // Last: consumers wait for it
+        }
+        h->producer_pid = getpid();
+        std::cerr << "[ring] publishing figures to " << name << " (" << (ring->capacity_ >> 20) << " MB)" << std::endl;
+        return ring;
+    }
+};
+
+// ==========================================
+// Deferred OCR Queue (Two-Tier Output)
+// ==========================================
+// Candidates with a clear-cut text density are written as soon as their page
+// is scanned. The ambiguous ones (which need OCR) wait here with their page
+// and are resolved by a few low-priority OCR workers, which give Tesseract
+// each page once and select the candidates on it; closing the queue at the
+// end of the document drains it, which is the final reconciliation.
+
+struct DeferredCandidate {
+    cv::Rect box;             // Position on the page
+    std::string output_base;  // Name reserved when the page was scanned
+};
+
+struct DeferredPage {
+    cv::Mat image;            // The page's pixels, shared with the scan that is done with them
+    PixelFormat format;
+    int page;
+    std::vector<DeferredCandidate> candidates;
+};
+
+// Page pixels held by the queue at most; detection waits for the OCR workers
+// beyond this, so pages full of ambiguous candidates cannot pile up
+// unbounded memory
+const size_t DEFERRED_OCR_MAX_BYTES = (size_t)256 << 20;
+
+struct DeferredOcrQueue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable space;  // Producers waiting for queued bytes to drop
+    std::deque<DeferredPage> items;
+    size_t bytes = 0;
+    bool closed = false;
+
+    static size_t item_bytes(const DeferredPage& p) { return p.image.total() * p.image.elemSize(); }
+
+    // Blocks while the queue is over its byte budget (a lone item always fits)
+    void push(DeferredPage c) {
+        size_t size = item_bytes(c);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            space.wait(lock, [&] { return items.empty() || bytes + size <= DEFERRED_OCR_MAX_BYTES; });
+            bytes += size;
+            items.push_back(std::move(c));
+        }
+        cv.notify_one();
+    }
+
+    // Blocks until an item is available; false once closed and drained
+    bool pop(DeferredPage& out) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return closed || !items.empty(); });
+            if (items.empty()) return false;
+            out = std::move(items.front());
+            items.pop_front();
+            bytes -= item_bytes(out);
+        }
+        space.notify_all();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+const int DEFERRED_OCR_THREADS = std::max(1, MAX_CV_THREADS / 4);
+const int DEFERRED_OCR_NICE = 10;
+
+bool figure_seen_before(const cv::Mat& pixels, const std::string& output_path, const DocumentSource& source);
+
+// Write one figure crop; SVG from the source PDF when possible, PNG otherwise
+void write_figure(const cv::Mat& pixels, const cv::Rect& box, int page, const DocumentSource& source, const std::string& output_base) {
+    if (!source.vector_pdf.empty() && page > 0 &&
+        write_vector_figure(source.vector_pdf, page, box, output_base + ".svg")) {
+        return;
+    }
+    FigureRing* ring = FigureRing::instance();
+    if (ring && ring->publish(pixels, box, page, output_base)) return;
+    if (figure_seen_before(pixels, output_base + ".png", source)) return;
+    cv::imwrite(output_base + ".png", pixels);
+}
+
+tesseract::TessBaseAPI* create_tesseract() {
+    tesseract::TessBaseAPI* tess = new tesseract::TessBaseAPI();
+    if (tess->Init(NULL, "eng")) {
+        delete tess;
+        return nullptr;
+    }
+    tess->SetPageSegMode(tesseract::PSM_AUTO);
+    return tess;
+}
+
+void deferred_ocr_worker(DeferredOcrQueue* queue, const DocumentSource* source) {
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DEFERRED_OCR_NICE);
+    tesseract::TessBaseAPI* tess = create_tesseract();
+
+    DeferredPage p;
+    while (queue->pop(p)) {
+        bool pageSet = false;
+        if (tess) {
+            cv::Mat gray;
+            toGray(p.image, p.format, gray);
+            pageSet = setOcrPage(tess, gray);
+        }
+        for (const auto& c : p.candidates) {
+            std::string text;
+            bool isText = tess && (pageSet ? isTextBlockInPage(tess, c.box, text)
+                                           : isTextBlock(tess, p.image(c.box), p.format, text));
+            if (isText) continue;
+            write_figure(p.image(c.box), c.box, p.page, *source, c.output_base);
+        }
+        if (tess) tess->Clear(); // Drop the page before waiting for the next
+    }
+
+    if (tess) {
+        tess->End();
+        delete tess;
+    }
+}
+
+// ==========================================
+// Prefork Detection Workers (Crash Isolation)
+// ==========================================
+// Both ends of a shared-memory page slot; main.cpp forks the processes.
+
+// Serve detection requests on one slot until the worker is killed
+void prefork_serve(int index) {
+    PageSlot* slot = prefork_slot(index);
+    tesseract::TessBaseAPI* tess = nullptr;
+
+    slot_lock(slot);
+    slot->worker_pid = getpid();
+    pthread_mutex_unlock(&slot->mutex);
+
+    while (true) {
+        slot_lock(slot);
+        while (slot->state != SLOT_REQUEST) {
+            if (pthread_cond_wait(&slot->cond, &slot->mutex) == EOWNERDEAD) pthread_mutex_consistent(&slot->mutex);
+        }
+        slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&slot->mutex);
+
+        cv::Mat image(slot->rows, slot->cols, slot->type, prefork_pixels(index), slot->step);
+        if (slot->use_ocr && !tess) tess = create_tesseract();
+        g_layout_engine = (LayoutEngine)slot->layout_engine;
+        g_binarizer = (Binarizer)slot->binarizer;
+
+        std::vector<cv::Rect> ambiguous;
+        std::vector<cv::Rect> figures = extractFigures(image, (PixelFormat)slot->format, tess, tess != nullptr,
+                                                       slot->defer_ocr ? &ambiguous : nullptr);
+
+        // Confident figures take the slots first; each list is cut on its own
+        int confident = std::min((int)figures.size(), PREFORK_MAX_FIGURES);
+        int deferred = std::min((int)ambiguous.size(), PREFORK_MAX_FIGURES - confident);
+        figures.resize(confident);
+        figures.insert(figures.end(), ambiguous.begin(), ambiguous.begin() + deferred);
+
+        slot_lock(slot);
+        for (int i = 0; i < confident + deferred; i++) {
+            slot->figures[i][0] = figures[i].x;
+            slot->figures[i][1] = figures[i].y;
+            slot->figures[i][2] = figures[i].width;
+            slot->figures[i][3] = figures[i].height;
+        }
+        slot->figure_count = confident + deferred;
+        slot->deferred_count = deferred;
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&slot->cond);
+        pthread_mutex_unlock(&slot->mutex);
+    }
+}
+
+static bool slot_running(int state) { return state == SLOT_REQUEST || state == SLOT_BUSY; }
+
+static bool slot_offline(int index) {
+    PageSlot* slot = prefork_slot(index);
+    slot_lock(slot);
+    bool offline = slot->state == SLOT_OFFLINE;
+    pthread_mutex_unlock(&slot->mutex);
+    return offline;
+}
+
+// Claim a free slot; -1 when every slot is offline or, with wait false, taken
+static int prefork_acquire(bool wait) {
+    std::unique_lock<std::mutex> lock(g_prefork_mutex);
+    if (g_prefork_workers == 0) return -1;
+    int index = -1;
+    auto free_slot = [&] {
+        bool online = false;
+        for (int i = 0; i < g_prefork_workers; i++) {
+            if (slot_offline(i)) continue;
+            online = true;
+            if (!g_prefork_slot_busy[i]) { index = i; return true; }
+        }
+        return !online;
+    };
+    if (wait) g_prefork_cv.wait(lock, free_slot);
+    else free_slot();
+    if (index < 0) return -1;
+    g_prefork_slot_busy[index] = true;
+    return index;
+}
+
+// Return a slot to the pool once its result has been read
+static void prefork_release(int index) {
+    PageSlot* slot = prefork_slot(index);
+    slot_lock(slot);
+    if (slot->state != SLOT_OFFLINE) slot->state = SLOT_IDLE;
+    pthread_mutex_unlock(&slot->mutex);
+    {
+        std::lock_guard<std::mutex> lock(g_prefork_mutex);
+        g_prefork_slot_busy[index] = false;
+    }
+    g_prefork_cv.notify_one();
+}
+
+// False when the slot went offline since it was acquired
+static bool prefork_submit(int index, const cv::Mat& image, PixelFormat format, bool use_ocr, bool defer_ocr,
+                           LayoutEngine engine) {
+    PageSlot* slot = prefork_slot(index);
+    cv::Mat shared(image.rows, image.cols, image.type(), prefork_pixels(index));
+    image.copyTo(shared);
+
+    slot_lock(slot);
+    if (slot->state == SLOT_OFFLINE) {
+        pthread_mutex_unlock(&slot->mutex);
+        return false;
+    }
+    slot->rows = image.rows;
+    slot->cols = image.cols;
+    slot->type = image.type();
+    slot->step = shared.step;
+    slot->format = (int)format;
+    slot->use_ocr = use_ocr;
+    slot->defer_ocr = defer_ocr;
+    slot->layout_engine = (int)engine;
+    slot->binarizer = (int)g_binarizer;
+    slot->state = SLOT_REQUEST;
+    pthread_cond_broadcast(&slot->cond);
+    pthread_mutex_unlock(&slot->mutex);
+    return true;
+}
+
+// State of a slot after waiting up to timeout_ms for its request to finish
+static int prefork_wait(int index, int timeout_ms) {
+    PageSlot* slot = prefork_slot(index);
+    slot_lock(slot);
+    if (slot_running(slot->state) && timeout_ms > 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&slot->cond, &slot->mutex, &deadline) == EOWNERDEAD) {
+            pthread_mutex_consistent(&slot->mutex);
+        }
+    }
+    if (slot_running(slot->state) && kill(g_prefork_supervisor, 0) != 0) slot->state = SLOT_FAILED; // No one left to report
+    int state = slot->state;
+    pthread_mutex_unlock(&slot->mutex);
+    return state;
+}
+
+// Withdraw a request whose result is no longer wanted. A worker already on
+// it is killed; the supervisor fails the slot and starts a replacement.
+static void prefork_cancel(int index) {
+    PageSlot* slot = prefork_slot(index);
+    slot_lock(slot);
+    if (slot->state == SLOT_REQUEST) slot->state = SLOT_FAILED;
+    else if (slot->state == SLOT_BUSY && slot->worker_pid > 0) kill(slot->worker_pid, SIGKILL);
+    pthread_mutex_unlock(&slot->mutex);
+    while (slot_running(prefork_wait(index, 100))) {}
+}
+
+// Run extractFigures on a worker. Returns false if the page cannot be handed
+// off (pool not running or offline, page too large); crashed is set when the worker died
+// on this page, in which case no figures are returned. A straggling page gets
+// a second worker running the other layout engine; the first result back is
+// used and the other worker is killed.
+bool prefork_extract(const cv::Mat& image, PixelFormat format, bool use_ocr, bool defer_ocr,
+                     std::vector<cv::Rect>& figures, std::vector<cv::Rect>& ambiguous, bool& crashed) {
+    crashed = false;
+    if (image.total() * image.elemSize() > PREFORK_SLOT_BYTES) return false;
+
+    int slots[2] = {prefork_acquire(true), -1};
+    if (slots[0] < 0) return false;
+    if (!prefork_submit(slots[0], image, format, use_ocr, defer_ocr, g_layout_engine)) {
+        prefork_release(slots[0]);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int states[2] = {SLOT_REQUEST, SLOT_FAILED};
+    int winner = -1;
+    while (true) {
+        // Sleep on one copy that is still running, then look at the other
+        int waiting = slot_running(states[0]) ? 0 : 1;
+        states[waiting] = prefork_wait(slots[waiting], g_speculate ? 100 : 1000);
+        if (slots[1 - waiting] >= 0) states[1 - waiting] = prefork_wait(slots[1 - waiting], 0);
+
+        if (states[0] == SLOT_DONE) winner = 0;
+        else if (states[1] == SLOT_DONE) winner = 1;
+        if (winner >= 0 || (!slot_running(states[0]) && !slot_running(states[1]))) break;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (slots[1] < 0 && slot_running(states[0]) && should_speculate(g_cv_stage, elapsed)) {
+            slots[1] = prefork_acquire(false);
+            LayoutEngine other = g_layout_engine == LayoutEngine::XYCut ? LayoutEngine::Contours : LayoutEngine::XYCut;
+            if (slots[1] >= 0 && !prefork_submit(slots[1], image, format, use_ocr, defer_ocr, other)) {
+                prefork_release(slots[1]);
+                slots[1] = -1;
+            }
+            if (slots[1] >= 0) {
+                states[1] = SLOT_REQUEST;
+                g_cv_stage.speculative++;
+                std::cout << "[speculate] " << t_doc->name << ": detection still running after " << std::fixed
+                          << std::setprecision(1) << elapsed << " s, starting a backup" << std::endl;
+            }
+        }
+    }
+
+    // The worker went away because it cannot run at all, not because of this
+    // page: hand the page back for detection in process
+    bool offline = winner < 0 && states[0] == SLOT_OFFLINE;
+    crashed = (winner < 0) && !offline;
+    if (winner >= 0) {
+        PageSlot* slot = prefork_slot(slots[winner]);
+        slot_lock(slot);
+        int confident = slot->figure_count - slot->deferred_count;
+        for (int i = 0; i < slot->figure_count; i++) {
+            cv::Rect r(slot->figures[i][0], slot->figures[i][1], slot->figures[i][2], slot->figures[i][3]);
+            (i < confident ? figures : ambiguous).push_back(r);
+        }
+        pthread_mutex_unlock(&slot->mutex);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (slots[i] < 0) continue;
+        if (slot_running(states[i])) prefork_cancel(slots[i]);
+        prefork_release(slots[i]);
+    }
+    if (slots[1] >= 0) {
+        g_cv_stage.speculative--;
+        std::cout << "[speculate] " << t_doc->name << ": " << (winner == 1 ? "backup" : "original")
+                  << " detection finished first" << std::endl;
+    }
+    return !offline;
+}
+
+// Detect and write the figures of one page image (Thread Safe)
+// base_name names the outputs; page is 0 when the image is not a rendered page
+void process_page(cv::Mat& image, const std::string& base_name, int page, const std::string& output_folder,
+                  bool use_tesseract, const DocumentSource& source) {
+    tesseract::TessBaseAPI* tess = nullptr;
+    PixelFormat format = classify_pixel_format(image);
+    count_cost(g_pixel_area, &DocCosts::pixel_area, (long long)image.total());
+
+    std::string opencv_folder = output_folder + "/opencv_figures";
+    mkdir(opencv_folder.c_str(), 0777);
+
+    int figure_index = 0;
+
+    auto placed = source.placements.find(page);
+    if (page > 0 && placed != source.placements.end() && placed->second.width > 0) {
+        double sx = image.cols / placed->second.width;
+        double sy = image.rows / placed->second.height;
+        cv::Rect page_rect(0, 0, image.cols, image.rows);
+
+        // Form XObjects: crop each drawing directly (rasters inside it included).
+        // Largest first, so a form nested in another is always seen after it.
+        std::vector<cv::Rect> placed_forms;
+        for (const auto& form : placed->second.forms) {
+            cv::Rect box((int)(form.left * sx), (int)(form.top * sy), (int)std::ceil(form.width * sx), (int)std::ceil(form.height * sy));
+            box &= page_rect;
+            if (box.width < 100 || box.height < 100) continue;
+            if (box.area() > 0.9 * page_rect.area()) continue; // Whole-page wrappers, not figures
+            placed_forms.push_back(box);
+        }
+        std::stable_sort(placed_forms.begin(), placed_forms.end(),
+                         [](const cv::Rect& a, const cv::Rect& b) { return a.area() > b.area(); });
+
+        std::vector<cv::Rect> form_boxes;
+        for (const auto& box : placed_forms) {
+            bool nested = false;
+            for (const auto& other : form_boxes) nested |= (box & other) == box;
+            if (nested || !isFigureForm(image(box), format)) continue;
+
+            std::string output_base = opencv_folder + "/" + base_name + "_figure_" + std::to_string(++figure_index);
+            write_figure(image(box).clone(), box, page, source, output_base);
+            form_boxes.push_back(box);
+        }
+        for (const auto& box : form_boxes) image(box).setTo(cv::Scalar(255, 255, 255));
+
+        // Known rasters: take the embedded original and blank its region on the page
+        for (const auto& img : placed->second.images) {
+            cv::Rect box((int)(img.left * sx), (int)(img.top * sy), (int)(img.width * sx), (int)(img.height * sy));
+            box &= page_rect;
+            if (box.width < 100 || box.height < 100) continue;
+            bool in_form = false;
+            for (const auto& form : form_boxes) in_form |= (box & form) == box;
+            if (in_form) continue;
+
+            std::string output_base = opencv_folder + "/" + base_name + "_figure_" + std::to_string(++figure_index);
+            FigureRing* ring = FigureRing::instance();
+            std::string output_path = output_base + img.path.substr(img.path.find_last_of('.'));
+            cv::Mat native = ring ? cv::imread(img.path, cv::IMREAD_COLOR) : cv::Mat();
+            if (!native.empty() && ring->publish(native, box, page, output_base)) {
+                unlink(img.path.c_str());
+            } else if (!source.seen_root.empty() &&
+                       figure_seen_before(cv::imread(img.path, cv::IMREAD_UNCHANGED), output_path, source)) {
+                unlink(img.path.c_str());
+            } else {
+                rename(img.path.c_str(), output_path.c_str());
+            }
+            count_cost(g_images, &DocCosts::images);
+            image(box).setTo(cv::Scalar(255, 255, 255));
+        }
+    }
+
+    bool ocr = use_tesseract && support_TESSERACT;
+    std::vector<cv::Rect> ambiguous;
+    std::vector<cv::Rect> figures;
+    bool handled = false;
+    auto detect_start = std::chrono::steady_clock::now();
+    long long ocr_before = t_ocr_ns;
+
+    if (g_use_prefork && support_PREFORK) {
+        bool crashed = false;
+        handled = prefork_extract(image, format, ocr, source.ocr_queue != nullptr, figures, ambiguous, crashed);
+        if (crashed) {
+            std::cerr << "[prefork] detection worker died on " << output_folder << "/" << base_name << ", page skipped" << std::endl;
+        }
+    }
+
+    if (!handled) {
+        // Initialize Tesseract locally for this thread (deferred OCR has its own workers)
+        if (ocr && !source.ocr_queue) tess = create_tesseract();
+        figures = extractFigures(image, format, tess, (tess != nullptr),
+                                 source.ocr_queue ? &ambiguous : nullptr);
+    }
+    count_cost(g_detect_ns, &DocCosts::detect_ns, elapsed_ns(detect_start) - (t_ocr_ns - ocr_before));
+
+    for (size_t i = 0; i < figures.size(); i++) {
+        std::string output_base = opencv_folder + "/" + base_name + "_figure_" + std::to_string(++figure_index);
+        write_figure(image(figures[i]), figures[i], page, source, output_base);
+    }
+
+    if (!ambiguous.empty()) {
+        DeferredPage deferred{image, format, page, {}};
+        for (const auto& box : ambiguous) {
+            std::string output_base = opencv_folder + "/" + base_name + "_figure_" + std::to_string(++figure_index);
+            deferred.candidates.push_back({box, output_base});
+        }
+        source.ocr_queue->push(std::move(deferred));
+    }
+
+    if (tess) {
+        tess->End();
+        delete tess;
+    }
+}
+
+// Process a single image file (Thread Safe)
+void process_single_image(const std::string& image_path, const std::string& output_folder, bool use_tesseract, const DocumentSource& source) {
+    StageTask task(g_cv_stage, output_folder, page_number_from_filename(image_path));
+
+    cv::Mat image = cv::imread(image_path, cv::IMREAD_UNCHANGED);
+    if (!image.empty()) {
+        task.bytes = image.total() * image.elemSize();
+        size_t last_slash = image_path.find_last_of("/\\");
+        size_t last_dot = image_path.find_last_of(".");
+        std::string base_name = image_path.substr(last_slash + 1, last_dot - last_slash - 1);
+        process_page(image, base_name, page_number_from_filename(image_path), output_folder, use_tesseract, source);
+    }
+
+    // Atomic Increment
+    g_processed_work_units++;
+}
+
+// Two-tier output for one document: while in scope, ambiguous candidates go
+// to low-priority OCR workers; finish() is the final reconciliation.
+struct DeferredOcrScope {
+    DocumentSource doc;
+    DeferredOcrQueue queue;
+    std::vector<std::thread> workers;
+
+    DeferredOcrScope(const DocumentSource& source, bool use_tesseract) : doc(source) {
+        if (g_defer_ocr && use_tesseract && support_TESSERACT) {
+            doc.ocr_queue = &queue;
+            int count = g_use_multithreading ? DEFERRED_OCR_THREADS : 1;
+            for (int i = 0; i < count; i++) {
+                workers.push_back(spawn_task([this] { deferred_ocr_worker(&queue, &doc); }));
+            }
+        }
+    }
+
+    // Every page is scanned, let the OCR workers drain the queue
+    void finish() {
+        queue.close();
+        for (auto& t : workers) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    ~DeferredOcrScope() { finish(); }
+};
+
+void process_extracted_images_with_opencv(const std::string& folder_path, bool use_tesseract, const DocumentSource& source = DocumentSource()) {
+    std::vector<std::string> image_files;
+    DIR* dir;
+    struct dirent* entry;
+
+    if ((dir = opendir(folder_path.c_str())) != nullptr) {
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string filename = entry->d_name;
+            if (filename.size() > 4 &&
+                (filename.substr(filename.size()-4) == ".png" ||
+                 filename.substr(filename.size()-4) == ".jpg" ||
+                 filename.substr(filename.size()-4) == ".tif" ||
+                 filename.substr(filename.size()-5) == ".jpeg")) {
+                image_files.push_back(folder_path + "/" + filename);
+            }
+        }
+        closedir(dir);
+    }
+
+    if (image_files.empty()) return;
+    g_cv_stage.enqueue((int)image_files.size());
+
+    DeferredOcrScope deferred(source, use_tesseract);
+    const DocumentSource& doc = deferred.doc;
+
+    // Parallel vs Serial Processing Loop
+    std::vector<std::thread> threads;
+    int active_threads = 0;
+
+    for (const auto& image_path : image_files) {
+        if (g_use_multithreading) {
+            // Limit concurrency
+            while (active_threads >= g_cv_stage.limit) {
+                for (auto& t : threads) {
+                    if (t.joinable()) {
+                        t.join();
+                        active_threads--;
+                    }
+                }
+                threads.erase(
+                    std::remove_if(threads.begin(), threads.end(), 
+                        [](std::thread& t){ return !t.joinable(); }),
+                    threads.end());
+            }
+            threads.push_back(spawn_task([&doc, image_path, folder_path, use_tesseract] {
+                process_single_image(image_path, folder_path, use_tesseract, doc);
+            }));
+            active_threads++;
+        } else {
+            // Serial
+            process_single_image(image_path, folder_path, use_tesseract, doc);
+        }
+    }
+
+    // Join remaining threads (only in parallel mode)
+    if (g_use_multithreading) {
+        for (auto& t : threads) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    deferred.finish();
+}
+
+// ==========================================
+// Compressed Page Store (In-Memory Pipeline)
+// ==========================================
+// Rendered pages wait for detection zstd-compressed in memory instead of as
+// PNG files. Raw document pages compress 5-10x at level 1 for a fraction of
+// the cost of PNG encoding. Past the byte budget, pages are spilled to a
+// scratch folder, still compressed.
+
+const size_t PAGE_STORE_DEFAULT_MB = 512; // Override with DOCIMG_PAGE_STORE_MB
+const int PAGE_STORE_ZSTD_LEVEL = 1;
+
+class PageStore {
+public:
+    PageStore(size_t budget, const std::string& scratch) : budget_(budget), scratch_(scratch) {}
+
+    ~PageStore() {
+        if (spilled_) {
+            std::string rm = "rm -rf '" + scratch_ + "'";
+            run_command(rm.c_str());
+        }
+    }
+
+    void put(int key, const cv::Mat& page) {
+        cv::Mat raw = page.isContinuous() ? page : page.clone();
+        size_t raw_size = raw.total() * raw.elemSize();
+
+        Entry e;
+        e.rows = raw.rows;
+        e.cols = raw.cols;
+        e.type = raw.type();
+        e.raw_size = raw_size;
+        e.data.resize(ZSTD_compressBound(raw_size));
+        size_t n = ZSTD_compress(e.data.data(), e.data.size(), raw.data, raw_size, PAGE_STORE_ZSTD_LEVEL);
+        if (ZSTD_isError(n)) return;
+        e.data.resize(n);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (used_ + n > budget_) {
+            // Over budget: keep only the compressed bytes on scratch disk
+            if (!spilled_) mkdir(scratch_.c_str(), 0777);
+            spilled_ = true;
+            e.spill_path = scratch_ + "/" + std::to_string(key) + ".zst";
+            std::ofstream out(e.spill_path, std::ios::binary);
+            out.write((const char*)e.data.data(), n);
+            e.data.clear();
+            e.data.shrink_to_fit();
+        } else {
+            used_ += n;
+        }
+        entries_[key] = std::move(e);
+    }
+
+    // Removes the page from the store; empty Mat if unknown
+    cv::Mat take(int key) {
+        Entry e;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it == entries_.end()) return cv::Mat();
+            e = std::move(it->second);
+            entries_.erase(it);
+            used_ -= e.data.size();
+        }
+
+        if (!e.spill_path.empty()) {
+            std::ifstream in(e.spill_path, std::ios::binary | std::ios::ate);
+            e.data.resize((size_t)in.tellg());
+            in.seekg(0);
+            in.read((char*)e.data.data(), e.data.size());
+            unlink(e.spill_path.c_str());
+        }
+
+        cv::Mat page(e.rows, e.cols, e.type);
+        size_t n = ZSTD_decompress(page.data, e.raw_size, e.data.data(), e.data.size());
+        if (ZSTD_isError(n) || n != e.raw_size) return cv::Mat();
+        return page;
+    }
+
+private:
+    struct Entry {
+        int rows = 0, cols = 0, type = 0;
+        size_t raw_size = 0;
+        std::vector<uchar> data;  // Compressed bytes (empty when spilled)
+        std::string spill_path;
+    };
+
+    std::mutex mutex_;
+    std::map<int, Entry> entries_;
+    size_t budget_;
+    size_t used_ = 0;
+    std::string scratch_;
+    bool spilled_ = false;
+};
+
+
+size_t page_store_budget() {
+    const char* env = getenv("DOCIMG_PAGE_STORE_MB");
+    size_t mb = (env && atol(env) > 0) ? (size_t)atol(env) : PAGE_STORE_DEFAULT_MB;
+    return mb << 20;
+}
+
+// pdftoppm without an output root writes a single PPM page to stdout; a
+// straggling page gets a pdftocairo copy writing PNG there instead
+cv::Mat render_pdf_page_to_memory(const std::string& filepath, int page) {
+    std::string range = "-f " + std::to_string(page) + " -l " + std::to_string(page) +
+                        " -r " + std::to_string(PDF_RENDER_DPI) + " '" + filepath + "'";
+    std::string cmd = "pdftoppm " + range + " 2>/dev/null";
+    std::string backup = support_PDF_VECTOR ? "pdftocairo -png -singlefile " + range + " - 2>/dev/null" : "";
+
+    std::vector<uchar> encoded;
+    if (run_speculative(g_render_stage, page, cmd, backup, &encoded) < 0 || encoded.empty()) return cv::Mat();
+    return cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+}
+
+// Long-lived workers of one stage: any number may be started, but only as
+// many as the stage's live limit take work at a time, so autotune changes
+// apply within the document as they do on the per-file path. A raised limit
+// lets a waiting worker in when the next task finishes.
+struct StageGate {
+    StageTuner& stage;
+    std::mutex mutex;
+    std::condition_variable cv;
+    int running = 0;
+
+    explicit StageGate(StageTuner& s) : stage(s) {}
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return running < (g_use_multithreading ? stage.limit.load() : 1); });
+        running++;
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+        }
+        cv.notify_all();
+    }
+};
+
+// Render and detect one PDF with the two stages overlapped: render workers
+// put pages into the store, detection workers take them out as they arrive.
+void render_and_detect_pdf_in_memory(const std::string& filepath, const std::string& output_folder,
+                                     bool use_tesseract, const DocumentSource& source,
+                                     const std::vector<bool>& todo = std::vector<bool>()) {
+    int pages = get_page_count(filepath, "pdf");
+    PageStore store(page_store_budget(), output_folder + "/_page_store");
+    DeferredOcrScope deferred(source, use_tesseract);
+
+    std::mutex ready_mutex;
+    std::condition_variable ready_cv;
+    std::deque<int> ready;
+    int rendered = 0;
+    std::atomic<int> next_page{1};
+
+    // Same names pdftoppm would give the page files
+    int digits = (int)std::to_string(pages).size();
+    auto page_name = [digits](int page) {
+        std::stringstream ss;
+        ss << "page-" << std::setw(digits) << std::setfill('0') << page;
+        return ss.str();
+    };
+
+    int selected = todo.empty() ? pages : (int)std::count(todo.begin(), todo.end(), true);
+    g_render_stage.enqueue(selected);
+    g_cv_stage.enqueue(selected);
+
+    StageGate render_gate(g_render_stage), detect_gate(g_cv_stage);
+
+    auto render_worker = [&]() {
+        while (true) {
+            render_gate.acquire();
+            int page = next_page++;
+            if (page > pages) {
+                render_gate.release();
+                return;
+            }
+            if (!todo.empty() && (page >= (int)todo.size() || !todo[page])) {
+                render_gate.release();
+                std::lock_guard<std::mutex> lock(ready_mutex);
+                if (++rendered == pages) ready_cv.notify_all();
+                continue;
+            }
+            {
+                StageTask task(g_render_stage, output_folder, page);
+                cv::Mat image = render_pdf_page_to_memory(filepath, page);
+                task.bytes = image.total() * image.elemSize();
+                if (!image.empty()) store.put(page, image);
+            }
+            render_gate.release();
+            g_processed_work_units++;
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(ready_mutex);
+                ready.push_back(page);
+                last = (++rendered == pages);
+            }
+            // The last page also wakes the idle detect workers so they exit
+            if (last) ready_cv.notify_all();
+            else ready_cv.notify_one();
+        }
+    };
+
+    auto detect_worker = [&]() {
+        while (true) {
+            int page;
+            detect_gate.acquire();
+            {
+                std::unique_lock<std::mutex> lock(ready_mutex);
+                ready_cv.wait(lock, [&] { return !ready.empty() || rendered == pages; });
+                if (ready.empty()) {
+                    lock.unlock();
+                    detect_gate.release();
+                    return;
+                }
+                page = ready.front();
+                ready.pop_front();
+            }
+            {
+                StageTask task(g_cv_stage, output_folder, page);
+                cv::Mat image = store.take(page);
+                task.bytes = image.total() * image.elemSize();
+                if (!image.empty()) {
+                    process_page(image, page_name(page), page, output_folder, use_tesseract, deferred.doc);
+                }
+            }
+            detect_gate.release();
+            g_processed_work_units++;
+        }
+    };
+
+    // Enough workers for the highest limit autotune can reach; the gates
+    // decide how many of them run
+    int render_threads = g_use_multithreading ? std::min(g_render_stage.max_limit, std::max(1, selected)) : 1;
+    int detect_threads = g_use_multithreading ? std::min(g_cv_stage.max_limit, std::max(1, selected)) : 1;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < render_threads; i++) threads.push_back(spawn_task(render_worker));
+    for (int i = 0; i < detect_threads; i++) threads.push_back(spawn_task(detect_worker));
+    for (auto& t : threads) t.join();
+
+    deferred.finish();
+}
+
+// ==========================================
+// Cross-Run Duplicate Index (Perceptual Hash)
+// ==========================================
+// Every figure written is reduced to a 64-bit DCT perceptual hash and looked
+// up in a BK-tree of all figures from earlier runs into the same output
+// directory (persisted as FIGURE_INDEX_FILE there). Near matches are removed
+// and recorded in the document's DUPLICATES_FILE instead of being shipped
+// again; new figures are appended to the index.
+
+const char* FIGURE_INDEX_FILE = "figure_index.txt";
+const char* DUPLICATES_FILE = "duplicates.tsv";
+const int PHASH_MAX_DISTANCE = 6; // Differing bits still counted as the same figure
+
+struct BkTree {
+    struct Node {
+        uint64_t hash;
+        std::string path;
+        std::map<int, int> children; // Distance -> node index
+    };
+    std::vector<Node> nodes;
+
+    static int distance(uint64_t a, uint64_t b) { return __builtin_popcountll(a ^ b); }
+
+    // Hash 0 means "no hash" (see perceptual_hash): it is never stored and
+    // never matches, so small or flat figures are not paired with each other
+    void insert(uint64_t hash, const std::string& path) {
+        if (hash == 0) return;
+        if (nodes.empty()) {
+            nodes.push_back({hash, path, {}});
+            return;
+        }
+        int i = 0;
+        while (true) {
+            int d = distance(hash, nodes[i].hash);
+            if (d == 0 && nodes[i].path == path) return;
+            auto child = nodes[i].children.find(d);
+            if (child == nodes[i].children.end()) {
+                nodes[i].children[d] = (int)nodes.size();
+                nodes.push_back({hash, path, {}});
+                return;
+            }
+            i = child->second;
+        }
+    }
+
+    // Closest entry within max_distance, or nullptr
+    const Node* find(uint64_t hash, int max_distance) const {
+        if (hash == 0 || nodes.empty()) return nullptr;
+        const Node* best = nullptr;
+        int best_d = max_distance + 1;
+        std::vector<int> stack{0};
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            int d = distance(hash, node.hash);
+            if (d < best_d) {
+                best_d = d;
+                best = &node;
+            }
+            for (const auto& child : node.children) {
+                if (child.first >= d - max_distance && child.first <= d + max_distance) stack.push_back(child.second);
+            }
+        }
+        return best;
+    }
+};
+
+BkTree g_figure_index;
+std::string g_figure_index_path; // Index file currently loaded
+std::mutex g_figure_index_mutex;
+
+// DCT hash: low 8x8 frequencies of a 32x32 grey thumbnail against their median
+// (0 for images too small or too flat to tell apart)
+uint64_t perceptual_hash(const cv::Mat& image) {
+    if (image.empty() || image.cols < 32 || image.rows < 32) return 0;
+    cv::Mat gray, small;
+    if (image.channels() == 1) gray = image;
+    else cv::cvtColor(image, gray, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+    cv::resize(gray, small, cv::Size(32, 32), 0, 0, cv::INTER_AREA);
+    small.convertTo(small, CV_32F);
+
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(small, mean, stddev);
+    if (stddev[0] < 2.0) return 0;
+
+    cv::Mat freq;
+    cv::dct(small, freq);
+    std::vector<float> coeffs;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) coeffs.push_back(freq.at<float>(y, x));
+    }
+    std::vector<float> sorted(coeffs.begin() + 1, coeffs.end()); // Without DC
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    float median = sorted[sorted.size() / 2];
+
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; i++) {
+        if (coeffs[i] > median) hash |= 1ULL << i;
+    }
+    return hash;
+}
+
+static void load_figure_index(const std::string& output_root) {
+    std::string path = output_root + "/" + FIGURE_INDEX_FILE;
+    if (path == g_figure_index_path) return;
+    g_figure_index = BkTree();
+    g_figure_index_path = path;
+
+    // "<16 hex digits> <figure>" per line; anything else (a line cut short
+    // by a crash, a hand edit) is skipped rather than failing the run
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long hash = strtoull(line.c_str(), &end, 16);
+        if (errno != 0 || end == line.c_str() || *end != ' ' || hash == 0) continue;
+        std::string figure = end + 1;
+        if (figure.empty()) continue;
+        g_figure_index.insert(hash, figure);
+    }
+}
+
+static void write_figure_index_entry(std::ostream& index, uint64_t hash, const std::string& figure) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    index << hex << " " << figure << "\n";
+}
+
+// Look a figure up before it is written to output_path (under
+// source.seen_root). A near match from an earlier document or run is recorded
+// in the document's DUPLICATES_FILE and true returned, so the caller writes
+// nothing; otherwise the figure joins the index.
+bool figure_seen_before(const cv::Mat& pixels, const std::string& output_path, const DocumentSource& source) {
+    if (source.seen_root.empty() || output_path.compare(0, source.seen_root.size() + 1, source.seen_root + "/") != 0) {
+        return false;
+    }
+    uint64_t hash = perceptual_hash(pixels);
+    if (hash == 0) return false;
+    std::string figure = output_path.substr(source.seen_root.size() + 1);
+
+    std::lock_guard<std::mutex> lock(g_figure_index_mutex);
+    load_figure_index(source.seen_root);
+    const BkTree::Node* seen = g_figure_index.find(hash, PHASH_MAX_DISTANCE);
+    if (seen && seen->path != figure) {
+        std::ofstream duplicates(source.seen_root + "/" + source.seen_document + "/" + DUPLICATES_FILE, std::ios::app);
+        duplicates << figure << "\t" << seen->path << "\n";
+        return true;
+    }
+    if (!seen) {
+        g_figure_index.insert(hash, figure);
+        std::ofstream index(g_figure_index_path, std::ios::app);
+        write_figure_index_entry(index, hash, figure);
+    }
+    return false;
+}
+
+// Remove figures of one document that earlier runs (or earlier documents)
+// already produced; folders are relative to output_root. For files other
+// tools wrote; figures this module writes are checked first (figure_seen_before).
+void skip_seen_figures(const std::string& output_root, const std::string& document_folder,
+                       const std::vector<std::string>& folders) {
+    std::lock_guard<std::mutex> lock(g_figure_index_mutex);
+    load_figure_index(output_root);
+
+    std::ofstream index(g_figure_index_path, std::ios::app);
+    std::ofstream duplicates;
+
+    for (const auto& folder : folders) {
+        DIR* dir = opendir((output_root + "/" + folder).c_str());
+        if (!dir) continue;
+        std::vector<std::string> names;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            std::string ext = name.substr(name.find_last_of('.') + 1);
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "gif" || ext == "bmp" ||
+                ext == "tif" || ext == "tiff" || ext == "ppm" || ext == "pgm" || ext == "pbm") {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+
+        for (const auto& name : names) {
+            std::string figure = folder + "/" + name;
+            std::string full_path = output_root + "/" + figure;
+            uint64_t hash = perceptual_hash(cv::imread(full_path, cv::IMREAD_UNCHANGED));
+            if (hash == 0) continue;
+
+            const BkTree::Node* seen = g_figure_index.find(hash, PHASH_MAX_DISTANCE);
+            if (seen && seen->path != figure) {
+                if (!duplicates.is_open()) {
+                    duplicates.open(output_root + "/" + document_folder + "/" + DUPLICATES_FILE, std::ios::app);
+                }
+                duplicates << figure << "\t" << seen->path << "\n";
+                unlink(full_path.c_str());
+                continue;
+            }
+            if (!seen) {
+                g_figure_index.insert(hash, figure);
+                write_figure_index_entry(index, hash, figure);
+            }
+        }
+    }
+}
+
+// ==========================================
+// Module Entry Point
+// ==========================================
+
+extern "C" const CvEngine* docimg_cv_engine() {
+    static const CvEngine engine = {
+        CV_ENGINE_ABI,
+        [](const std::string& folder, bool use_tesseract, const DocumentSource& source) {
+            process_extracted_images_with_opencv(folder, use_tesseract, source);
+        },
+        [](const std::string& filepath, const std::string& output_folder, bool use_tesseract,
+           const DocumentSource& source, const std::vector<bool>& todo) {
+            render_and_detect_pdf_in_memory(filepath, output_folder, use_tesseract, source, todo);
+        },
+        skip_seen_figures,
+        prefork_serve,
+    };
+    return &engine;
+}
@@ -0,0 +1,454 @@
+// Declarations shared by the application (main.cpp) and the detection module
+// (cv_engine.cpp, built as docimg_cv.so and loaded only when a run needs
+// OpenCV or Tesseract). Globals are defined once, in main.cpp; the executable
+// is linked with -rdynamic so the module binds to them at load time.
+#ifndef DOCIMG_H
+#define DOCIMG_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cerrno>
+#include <pthread.h>
+
+// ==========================================
+// Features & Run Options
+// ==========================================
+extern bool support_TESSERACT;
+extern bool support_PREFORK;
+extern bool support_PDF_VECTOR; // pdftocairo is installed
+
+extern bool g_use_multithreading;
+extern bool g_defer_ocr;
+extern bool g_use_prefork;
+extern bool g_speculate;
+extern std::atomic<int> g_processed_work_units;
+
+// Resolution pdftoppm renders pages at; figure boxes are in pixels at this DPI
+const int PDF_RENDER_DPI = 200;
+
+// Thread limits to prevent system overload on WSL
+const int MAX_RENDER_THREADS = std::max(2, (int)std::thread::hardware_concurrency());
+const int MAX_CV_THREADS = std::max(2, (int)std::thread::hardware_concurrency());
+
+// ==========================================
+// Scheduling Lanes
+// ==========================================
+// Interactive documents (small ones, or ones dropped into a watched folder's
+// priority subfolder) run beside the bulk lane instead of queueing behind
+// it. While any is running, bulk page tasks only get a quarter of each
+// stage's workers; the rest of the capacity is reserved for the interactive
+// lane. Tasks are gated as they start, so bulk work yields at page-task
+// granularity.
+enum class Lane { Bulk, Interactive };
+
+const int BULK_LANE_SHARE_DIVISOR = 4; // Bulk keeps limit / 4 (at least 1) workers
+
+extern std::atomic<int> g_interactive_docs;
+
+// ==========================================
+// Concurrency Auto-Tuning
+// ==========================================
+// Worker limit and counters of one pipeline stage; see autotune_thread_fn
+struct StageTuner {
+    const char* name;
+    std::atomic<int> limit;
+    std::atomic<int> queued{0};
+    std::atomic<int> active{0};
+    std::atomic<long> completed{0};
+    std::atomic<long long> busy_ns{0}; // Summed task time, for the cost ledger
+    std::atomic<int> speculative{0};   // Backup copies of straggling tasks running
+
+    int min_limit;
+    int max_limit;
+    int direction = 1;
+    long last_completed = 0;
+    double last_rate = -1.0;
+
+    // Lane gate: bulk tasks running in this stage
+    std::mutex gate_mutex;
+    std::condition_variable gate_cv;
+    int bulk_active = 0;
+
+    StageTuner(const char* n, int initial, int lo, int hi)
+        : name(n), limit(initial), min_limit(lo), max_limit(hi) {}
+
+    // Interactive tasks always start; bulk tasks wait for their share
+    void enter(Lane lane) {
+        if (lane != Lane::Bulk) return;
+        std::unique_lock<std::mutex> lock(gate_mutex);
+        gate_cv.wait(lock, [this] {
+            return g_interactive_docs.load() == 0 || bulk_active < std::max(1, limit.load() / BULK_LANE_SHARE_DIVISOR);
+        });
+        bulk_active++;
+    }
+
+    void leave(Lane lane) {
+        if (lane != Lane::Bulk) return;
+        {
+            std::lock_guard<std::mutex> lock(gate_mutex);
+            bulk_active--;
+        }
+        gate_cv.notify_one();
+    }
+
+    // Call after g_interactive_docs changes
+    void reopen_gate() {
+        std::lock_guard<std::mutex> lock(gate_mutex);
+        gate_cv.notify_all();
+    }
+
+    void enqueue(int n) { queued += n; }
+
+    void reset(int initial) {
+        limit = initial;
+        queued = 0;
+        direction = 1;
+        last_completed = completed;
+        last_rate = -1.0;
+    }
+
+    void tune(double seconds) {
+        long done = completed;
+        double rate = (done - last_completed) / seconds;
+        last_completed = done;
+
+        // Nothing to measure while the stage is idle
+        if (queued <= 0 && active == 0) {
+            last_rate = -1.0;
+            return;
+        }
+
+        int old_limit = limit;
+        if (last_rate >= 0.0 && rate < last_rate * 0.95) direction = -direction;
+        int new_limit = std::min(max_limit, std::max(min_limit, old_limit + direction));
+        if (new_limit == old_limit) direction = -direction;
+        limit = new_limit;
+        last_rate = rate;
+
+        std::cout << "[autotune] " << name << ": " << std::fixed << std::setprecision(2) << rate
+                  << " tasks/s, queue " << queued << ", active " << active
+                  << ", workers " << old_limit << " -> " << new_limit << std::endl;
+    }
+};
+
+extern StageTuner g_render_stage;
+extern StageTuner g_cv_stage;
+
+// ==========================================
+// Run Trace (for tools/trace_sim)
+// ==========================================
+extern FILE* g_trace;
+extern std::mutex g_trace_mutex;
+extern std::chrono::steady_clock::time_point g_trace_epoch;
+
+inline double thread_cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+inline std::string json_escape(const std::string& str) {
+    std::string out;
+    for (char c : str) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c >= 0x20) out += c;
+    }
+    return out;
+}
+
+// ==========================================
+// Straggler Detection
+// ==========================================
+// A few pages (huge vector maps, broken content streams) can take 50-100x
+// the median task time and hold up their whole document. Each document
+// keeps the durations of its finished tasks per stage; once the stage has
+// nothing queued and a free worker, a task running far past the median gets
+// a backup copy on a different backend, and whichever finishes first is
+// kept (see run_speculative and prefork_extract).
+const int STRAGGLER_MIN_SAMPLES = 8;       // Finished tasks needed for a baseline
+const double STRAGGLER_FACTOR = 5.0;       // Multiple of the median that marks an outlier
+const double STRAGGLER_MIN_SECONDS = 2.0;  // Shorter tasks are never duplicated
+
+struct TaskTimes {
+    std::mutex mutex;
+    std::vector<double> seconds;
+    double median = 0;
+
+    void add(double s) {
+        std::lock_guard<std::mutex> lock(mutex);
+        seconds.push_back(s);
+        // The median settles quickly; past 64 samples refresh it every 64th
+        size_t n = seconds.size();
+        if (n > 64 && n % 64 != 0) return;
+        std::nth_element(seconds.begin(), seconds.begin() + n / 2, seconds.end());
+        median = seconds[n / 2];
+    }
+
+    bool straggler(double elapsed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (int)seconds.size() >= STRAGGLER_MIN_SAMPLES &&
+               elapsed > std::max(STRAGGLER_MIN_SECONDS, STRAGGLER_FACTOR * median);
+    }
+};
+
+// ==========================================
+// Live Dashboard Counters
+// ==========================================
+// A document's share of the cost ledger counters (see count_cost)
+struct DocCosts {
+    std::atomic<long long> subprocesses{0};
+    std::atomic<long long> candidates{0};
+    std::atomic<long long> ocr_calls{0};
+    std::atomic<long long> pixel_area{0};
+    std::atomic<long long> images{0};
+    std::atomic<long long> render_ns{0};
+    std::atomic<long long> detect_ns{0};
+    std::atomic<long long> ocr_ns{0};
+    std::atomic<int> render_limit{0}; // Highest stage limit any of its tasks started under
+    std::atomic<int> detect_limit{0};
+};
+
+struct DocProgress {
+    std::string name;
+    std::atomic<Lane> lane{Lane::Bulk};
+    std::atomic<int> pages{0};    // 0 while the page count is unknown
+    std::atomic<int> rendered{0};
+    std::atomic<int> detected{0};
+    std::atomic<int> state{0};    // 0 queued, 1 running, 2 done
+    TaskTimes render_times;
+    TaskTimes detect_times;
+    DocCosts costs;
+
+    explicit DocProgress(const std::string& n) : name(n) {}
+};
+
+extern thread_local DocProgress* t_doc; // Document this thread works for
+
+// Add n to a process-wide counter and to the calling thread's document.
+// Threads working for no document (pre-scan, prefetch) only count globally.
+inline void count_cost(std::atomic<long long>& global, std::atomic<long long> DocCosts::*field, long long n = 1) {
+    global.fetch_add(n, std::memory_order_relaxed);
+    if (t_doc) (t_doc->costs.*field).fetch_add(n, std::memory_order_relaxed);
+}
+
+// Start a page task thread that works for the same document as the caller
+template<class F>
+std::thread spawn_task(F fn) {
+    DocProgress* doc = t_doc;
+    return std::thread([doc, fn]() mutable {
+        t_doc = doc;
+        fn();
+    });
+}
+
+inline TaskTimes& task_times(DocProgress& doc, StageTuner& stage) {
+    return &stage == &g_cv_stage ? doc.detect_times : doc.render_times;
+}
+
+// True when a task of stage that has run for elapsed seconds should get a
+// backup copy: it is an outlier for its document and the copy would only
+// use a worker nothing else is waiting for
+inline bool should_speculate(StageTuner& stage, double elapsed) {
+    if (!g_speculate || !t_doc || stage.queued > 0) return false;
+    if (stage.active + stage.speculative >= stage.limit) return false;
+    return task_times(*t_doc, stage).straggler(elapsed);
+}
+
+extern std::atomic<long long> g_detect_ns; // Detection time excluding inline OCR
+extern std::atomic<long long> g_ocr_ns;
+
+inline long long elapsed_ns(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// ==========================================
+// Cost Ledger Counters
+// ==========================================
+extern std::atomic<long long> g_subprocesses;
+extern std::atomic<long long> g_candidates;
+extern std::atomic<long long> g_ocr_calls;
+extern std::atomic<long long> g_pixel_area;
+extern std::atomic<long long> g_images;
+
+// Document shell-outs go through these so they can be counted
+int run_command(const char* cmd);
+FILE* open_command(const char* cmd, const char* mode);
+
+// Run primary as a page task of stage. If it turns into a straggler
+// (should_speculate) and backup is set, backup is started beside it; the
+// first to exit successfully wins and the other is killed. With out set,
+// the winner's stdout is collected into it. Returns 0 or 1 for the command
+// whose result stands, -1 if primary could not be started.
+int run_speculative(StageTuner& stage, int page, const std::string& primary, const std::string& backup,
+                    std::vector<unsigned char>* out = nullptr);
+
+// Marks one task of a stage as running for the lifetime of the object
+struct StageTask {
+    StageTuner& stage;
+    std::string doc;
+    int page;
+    size_t bytes = 0; // Page pixels produced or consumed, for the trace
+    std::chrono::steady_clock::time_point start;
+    double cpu_start = 0;
+    Lane lane;
+
+    explicit StageTask(StageTuner& s, const std::string& d = "", int p = 0)
+        : stage(s), doc(d), page(p), lane(t_doc ? t_doc->lane.load() : Lane::Bulk) {
+        stage.enter(lane);
+        stage.queued--;
+        stage.active++;
+        if (t_doc) {
+            std::atomic<int>& used = (&stage == &g_cv_stage) ? t_doc->costs.detect_limit : t_doc->costs.render_limit;
+            int limit = g_use_multithreading ? stage.limit.load() : 1;
+            int seen = used.load();
+            while (seen < limit && !used.compare_exchange_weak(seen, limit)) {}
+        }
+        start = std::chrono::steady_clock::now();
+        if (g_trace) cpu_start = thread_cpu_seconds();
+    }
+
+    ~StageTask() {
+        stage.active--;
+        stage.completed++;
+        stage.leave(lane);
+        long long ns = elapsed_ns(start);
+        stage.busy_ns.fetch_add(ns, std::memory_order_relaxed);
+        if (t_doc) {
+            (&stage == &g_cv_stage ? t_doc->detected : t_doc->rendered).fetch_add(1, std::memory_order_relaxed);
+            if (&stage == &g_render_stage) t_doc->costs.render_ns.fetch_add(ns, std::memory_order_relaxed);
+            task_times(*t_doc, stage).add(ns / 1e9);
+        }
+        if (!g_trace) return;
+
+        auto end = std::chrono::steady_clock::now();
+        double begin_s = std::chrono::duration<double>(start - g_trace_epoch).count();
+        double dur = std::chrono::duration<double>(end - start).count();
+        double cpu = thread_cpu_seconds() - cpu_start;
+
+        std::lock_guard<std::mutex> lock(g_trace_mutex);
+        if (!g_trace) return;
+        fprintf(g_trace, "{\"doc\":\"%s\",\"stage\":\"%s\",\"page\":%d,\"start\":%.6f,\"dur\":%.6f,\"cpu\":%.6f,\"bytes\":%zu}\n",
+                json_escape(doc).c_str(), stage.name, page, begin_s, dur, cpu, bytes);
+    }
+};
+
+// ==========================================
+// Documents & Pages
+// ==========================================
+enum class LayoutEngine { Contours, XYCut };
+extern LayoutEngine g_layout_engine;
+
+// Local thresholding of grayscale pages: OpenCV's Gaussian adaptive
+// threshold per region, or Sauvola once per page (see sauvolaBinarizeInv)
+enum class Binarizer { Gaussian, Sauvola };
+extern Binarizer g_binarizer;
+
+struct PlacedImage {
+    double left, top, width, height; // Page units from the XML
+    std::string path;                // Native-resolution image dumped by pdftohtml
+};
+
+struct PlacedForm {
+    double left, top, width, height; // Page units (points), top-left origin
+};
+
+struct PagePlacements {
+    double width = 0, height = 0;
+    std::vector<PlacedImage> images;
+    std::vector<PlacedForm> forms;   // Self-contained vector drawings
+};
+
+struct DeferredOcrQueue;
+
+// What is known about the document a folder of rendered pages came from
+struct DocumentSource {
+    std::string vector_pdf;                    // When set, figures are written as SVG crops of it
+    std::map<int, PagePlacements> placements;  // By page number
+    DeferredOcrQueue* ocr_queue = nullptr;     // When set, ambiguous candidates are OCR'd later
+    std::string seen_root;                     // When set, figures already in its duplicate index are not written
+    std::string seen_document;                 // Folder under seen_root whose duplicates.tsv records them
+};
+
+int get_page_count(const std::string& filepath, const std::string& ftype);
+int page_number_from_filename(const std::string& image_path);
+
+// ==========================================
+// Prefork Detection Workers (Shared Memory)
+// ==========================================
+const int PREFORK_MAX_WORKERS = 16;
+const size_t PREFORK_SLOT_BYTES = (size_t)48 << 20; // Largest page handed off (200 dpi A3 BGR fits)
+const int PREFORK_MAX_FIGURES = 256;
+
+enum SlotState { SLOT_IDLE, SLOT_REQUEST, SLOT_BUSY, SLOT_DONE, SLOT_FAILED,
+                 SLOT_OFFLINE }; // No worker can run on the slot; detect in process instead
+
+struct PageSlot {
+    pthread_mutex_t mutex;  // Process-shared, robust
+    pthread_cond_t cond;    // Process-shared
+    int state;
+    // Request
+    int rows, cols, type;
+    size_t step;
+    int format, use_ocr, defer_ocr, layout_engine, binarizer;
+    pid_t worker_pid;       // Set by the worker serving the slot
+    // Result: confident figures first, then deferred_count ambiguous ones
+    int figure_count, deferred_count;
+    int figures[PREFORK_MAX_FIGURES][4];
+};
+
+const size_t PREFORK_HEADER_BYTES = (sizeof(PageSlot) + 4095) & ~(size_t)4095;
+const size_t PREFORK_SLOT_STRIDE = PREFORK_HEADER_BYTES + PREFORK_SLOT_BYTES;
+
+extern unsigned char* g_prefork_shm;
+extern pid_t g_prefork_supervisor;
+
+extern std::mutex g_prefork_mutex;
+extern std::condition_variable g_prefork_cv;
+extern bool g_prefork_slot_busy[PREFORK_MAX_WORKERS];
+extern int g_prefork_workers;
+
+inline PageSlot* prefork_slot(int i) { return (PageSlot*)(g_prefork_shm + i * PREFORK_SLOT_STRIDE); }
+inline unsigned char* prefork_pixels(int i) { return g_prefork_shm + i * PREFORK_SLOT_STRIDE + PREFORK_HEADER_BYTES; }
+
+inline void slot_lock(PageSlot* slot) {
+    if (pthread_mutex_lock(&slot->mutex) == EOWNERDEAD) pthread_mutex_consistent(&slot->mutex);
+}
+
+// ==========================================
+// Detection Module Interface
+// ==========================================
+// The module exports DOCIMG_CV_ENTRY, returning its entry points. abi must
+// equal CV_ENGINE_ABI; bump it whenever this header changes layout.
+const int CV_ENGINE_ABI = 7;
+#define DOCIMG_CV_ENTRY "docimg_cv_engine"
+
+struct CvEngine {
+    int abi;
+    // Detect figures in every page image of a folder
+    void (*process_folder)(const std::string& folder, bool use_tesseract, const DocumentSource& source);
+    // Render and detect a PDF through the in-memory page store; todo as in IncrementalRun
+    void (*render_and_detect_pdf)(const std::string& filepath, const std::string& output_folder,
+                                  bool use_tesseract, const DocumentSource& source, const std::vector<bool>& todo);
+    // Cross-run duplicate removal (see skip_seen_figures)
+    void (*skip_seen_figures)(const std::string& output_root, const std::string& document_folder,
+                              const std::vector<std::string>& folders);
+    // Body of a prefork detection worker; never returns
+    void (*prefork_serve)(int index);
+};
+
+extern "C" const CvEngine* docimg_cv_engine();
+
+#endif
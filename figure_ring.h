@@ -0,0 +1,70 @@
+// Shared-memory figure ring: layout and signalling shared by the producer
+// (cv_engine.cpp) and consumer processes (see tools/figure_ring_dump.cpp).
+//
+// One POSIX shared-memory object holds a FigureRingHeader followed by
+// capacity bytes of records. There is one producer and one consumer. head and
+// tail count bytes ever written and released; a record is published by
+// advancing head and released by advancing tail, so a consumer reads pixels
+// in place and hands the space back when done. Both sides sleep on futexes
+// (head_seq for new records, tail_seq for freed space), which is where the
+// producer is held back when the consumer falls behind.
+#ifndef FIGURE_RING_H
+#define FIGURE_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+const uint32_t FIGURE_RING_MAGIC = 0x46524731; // "FRG1"
+const uint32_t FIGURE_RING_VERSION = 1;
+const size_t FIGURE_RING_ALIGN = 64;
+
+enum FigureRecordKind : uint32_t { FIGURE_RECORD = 1, FIGURE_RECORD_PAD = 2 };
+
+struct FigureRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;                   // Record bytes after the header
+    std::atomic<uint64_t> head;          // Bytes published (producer)
+    std::atomic<uint64_t> tail;          // Bytes released (consumer)
+    std::atomic<uint32_t> head_seq;      // Futex word, bumped after every publish
+    std::atomic<uint32_t> tail_seq;      // Futex word, bumped after every release
+    std::atomic<int32_t> producer_pid;
+    std::atomic<int32_t> consumer_pid;   // 0 when no consumer is attached
+};
+
+const size_t FIGURE_RING_HEADER_BYTES = (sizeof(FigureRingHeader) + 4095) & ~(size_t)4095;
+
+// Records never wrap: one that does not fit before the end of the ring is
+// preceded by a PAD record filling the rest. Pixels follow the record header,
+// 8 bits per sample, BGR or grey, rows * step bytes.
+struct FigureRecord {
+    uint32_t size;           // Whole record including pixels, multiple of FIGURE_RING_ALIGN
+    uint32_t kind;
+    int32_t page;            // 0 when the figure is not from a rendered page
+    int32_t x, y, width, height; // Box on the page, in pixels
+    int32_t rows, cols, channels;
+    uint32_t step;           // Bytes per pixel row
+    char name[468];          // Output path the figure would have had, without extension
+};
+
+static_assert(sizeof(FigureRecord) % FIGURE_RING_ALIGN == 0, "FigureRecord must keep pixels aligned");
+
+inline size_t figure_ring_align(size_t n) { return (n + FIGURE_RING_ALIGN - 1) & ~(FIGURE_RING_ALIGN - 1); }
+
+// Sleep until word changes from seen, or timeout_ms passes
+inline void figure_ring_wait(std::atomic<uint32_t>& word, uint32_t seen, int timeout_ms) {
+    struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, seen, &ts, nullptr, 0);
+}
+
+inline void figure_ring_wake(std::atomic<uint32_t>& word) {
+    word.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#endif
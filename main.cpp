@@ -15,6 +15,12 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <sstream>
+#include <fstream>
+#include <map>
+#include <set>
+#include <array>
+#include <cstring>
+#include <cctype>
 #include <cmath>
 #include <algorithm> // For std::min, std::max
 #include <iomanip>   // For std::setw, std::setfill
@@ -24,19 +30,42 @@
 #include <atomic>
 #include <mutex>
 #include <future>
-
-// Prevent X11 Status conflict
-#define Status Status_
-#include <opencv2/opencv.hpp>
-#undef Status
-
-// Tesseract Includes
-#include <tesseract/baseapi.h>
-#include <leptonica/allheaders.h>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+
+// Hot Folder Includes
+#include <sys/inotify.h>
+#include <poll.h>
+
+// Resource Usage (Cost Ledger)
+#include <sys/resource.h>
+
+// Prefork Worker Includes
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <pthread.h>
+#include <cerrno>
+
+// Detection Module Loading
+#include <dlfcn.h>
+#include <climits>
+
+#include "docimg.h"
 
 bool support_DJVU = true;
 bool support_PDF = true;
 bool support_PDF_RENDER = false; 
+bool support_PDF_VECTOR = false;
+bool support_PDF_PLACEMENT = false;
+bool support_QPDF = false;
 bool support_DOC = true;
 bool support_EPUB = true;
 bool support_OPENCV = false;
@@ -58,12 +87,23 @@ Fl_Button* b_output_dir = nullptr;
 Fl_Box* b_output_dir_label = nullptr;
 Fl_Progress* progress_bar = nullptr;
 Fl_Button* startb = nullptr;
+Fl_Button* watchb = nullptr;
 
 Fl_Check_Button* opencv_toggle = nullptr;
 Fl_Check_Button* tesseract_toggle = nullptr;
+Fl_Check_Button* deferocr_toggle = nullptr;
 Fl_Check_Button* multithread_toggle = nullptr;
+Fl_Check_Button* autotune_toggle = nullptr;
+Fl_Check_Button* vector_toggle = nullptr;
+Fl_Check_Button* xycut_toggle = nullptr;
+Fl_Check_Button* sauvola_toggle = nullptr;
+Fl_Check_Button* prefork_toggle = nullptr;
+Fl_Check_Button* pagestore_toggle = nullptr;
+Fl_Check_Button* seen_toggle = nullptr;
+Fl_Check_Button* speculate_toggle = nullptr;
 
 Fl_Box* status_box = nullptr;
+Fl_Text_Display* dashboard = nullptr;
 
 std::string input_files_count_str;
 std::vector<std::string> input_files_vec;
@@ -72,14 +112,173 @@ std::string output_dir_str;
 // ==========================================
 // Global Progress State (Thread Safe)
 // ==========================================
-int g_total_work_units = 0;
+std::atomic<int> g_total_work_units{0};
 std::atomic<int> g_processed_work_units{0};
+std::atomic<bool> g_processing_done{false};
 int g_current_file_index = 0;
 bool g_use_multithreading = true; // Default ON
+bool g_use_opencv = false;
+bool g_use_tesseract = false;
+bool g_vector_figures = false;
+bool g_defer_ocr = false;
+LayoutEngine g_layout_engine = LayoutEngine::Contours;
+Binarizer g_binarizer = Binarizer::Gaussian;
+bool g_use_page_store = false;
+bool g_skip_seen_figures = false;
+bool g_speculate = false;
+
+// ==========================================
+// Concurrency Auto-Tuning
+// ==========================================
+// Each pipeline stage has its own worker limit. With auto-tuning on, a
+// controller thread samples completed tasks per second and hill-climbs the
+// limit one worker at a time: keep moving while throughput improves,
+// reverse when it drops.
+const int AUTOTUNE_MAX_THREADS = 2 * std::max(2, (int)std::thread::hardware_concurrency());
+const double AUTOTUNE_INTERVAL = 2.0; // Seconds between samples
+
+StageTuner g_render_stage("render", MAX_RENDER_THREADS, 1, AUTOTUNE_MAX_THREADS);
+StageTuner g_cv_stage("detect", MAX_CV_THREADS, 1, AUTOTUNE_MAX_THREADS);
+
+bool g_use_autotune = false;
+std::atomic<bool> g_autotune_stop{false};
+
+// ==========================================
+// Scheduling Lanes
+// ==========================================
+// A document goes to the interactive lane when it has at most
+// INTERACTIVE_MAX_PAGES pages (DOCIMG_INTERACTIVE_PAGES; 0 turns the lane
+// off) and INTERACTIVE_MAX_MB bytes, or when it was dropped into the
+// WATCH_PRIORITY_DIR subfolder of a watched folder. Each lane processes its
+// documents in order on its own thread; see StageTuner::enter for how page
+// tasks share the workers.
+
+const int INTERACTIVE_MAX_PAGES = 20;
+const long long INTERACTIVE_MAX_MB = 64;
+
+std::atomic<int> g_interactive_docs{0};
+std::atomic<int> g_running_docs{0};
+std::atomic<long long> g_doc_starts{0};
+
+int interactive_max_pages() {
+    const char* env = getenv("DOCIMG_INTERACTIVE_PAGES");
+    return (env && *env) ? atoi(env) : INTERACTIVE_MAX_PAGES;
+}
+
+Lane classify_lane(const std::string& path, int pages) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return Lane::Bulk;
+    bool small = pages <= interactive_max_pages() && st.st_size <= (INTERACTIVE_MAX_MB << 20);
+    return small ? Lane::Interactive : Lane::Bulk;
+}
+
+// ==========================================
+// Run Trace (for tools/trace_sim)
+// ==========================================
+// With DOCIMG_TRACE=<file> set, every render and detect task is appended to
+// <file> as one JSON line: document, stage, page, start and duration (s,
+// relative to the run start), thread CPU time and page pixel bytes. CPU time
+// of render subprocesses is not included.
+
+FILE* g_trace = nullptr;
+std::mutex g_trace_mutex;
+std::chrono::steady_clock::time_point g_trace_epoch;
+
+void trace_open() {
+    const char* path = getenv("DOCIMG_TRACE");
+    if (!path || !*path || g_trace) return;
+    g_trace = fopen(path, "a");
+    g_trace_epoch = std::chrono::steady_clock::now();
+}
+
+void trace_close() {
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    if (g_trace) fclose(g_trace);
+    g_trace = nullptr;
+}
+
+// ==========================================
+// Live Dashboard Counters
+// ==========================================
+// Workers only bump relaxed atomics; the UI timer samples them and renders
+// the dashboard text, so the hot path never takes a lock for statistics.
+
+std::vector<std::shared_ptr<DocProgress>> g_docs;
+std::mutex g_docs_mutex; // Guards the list itself; rows are atomics
+thread_local DocProgress* t_doc = nullptr;
+
+std::atomic<long long> g_detect_ns{0};
+std::atomic<long long> g_ocr_ns{0};
+
+const int DASHBOARD_DOC_ROWS = 4;
+
+std::shared_ptr<DocProgress> dashboard_add_doc(const std::string& path) {
+    auto doc = std::make_shared<DocProgress>(path.substr(path.find_last_of('/') + 1));
+    std::lock_guard<std::mutex> lock(g_docs_mutex);
+    g_docs.push_back(doc);
+    return doc;
+}
+
+// Forget finished documents the dashboard can no longer show. Watch mode
+// adds a row per arriving file for as long as it runs; batch runs index
+// g_docs by input position and never trim.
+void dashboard_trim() {
+    std::lock_guard<std::mutex> lock(g_docs_mutex);
+    int excess = -DASHBOARD_DOC_ROWS;
+    for (const auto& d : g_docs) excess += d->state == 2;
+    for (auto it = g_docs.begin(); it != g_docs.end() && excess > 0;) {
+        if ((*it)->state == 2) {
+            it = g_docs.erase(it);
+            excess--;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void dashboard_reset() {
+    std::lock_guard<std::mutex> lock(g_docs_mutex);
+    g_docs.clear();
+    g_detect_ns = 0;
+    g_ocr_ns = 0;
+}
+
+// ==========================================
+// Cost Ledger Counters
+// ==========================================
+// Cumulative over the run. Each increment is also charged to the document the
+// thread works for (count_cost), and the ledger records that share, so work
+// for other documents, the pre-scan and prefetching stays out of it.
+
+std::atomic<long long> g_subprocesses{0};
+std::atomic<long long> g_candidates{0};
+std::atomic<long long> g_ocr_calls{0};
+std::atomic<long long> g_pixel_area{0};
+std::atomic<long long> g_images{0};
+
+// Document shell-outs go through these so they can be counted
+int run_command(const char* cmd) {
+    count_cost(g_subprocesses, &DocCosts::subprocesses);
+    return system(cmd);
+}
+
+FILE* open_command(const char* cmd, const char* mode) {
+    count_cost(g_subprocesses, &DocCosts::subprocesses);
+    return popen(cmd, mode);
+}
 
-// Thread limits to prevent system overload on WSL
-const int MAX_RENDER_THREADS = std::max(2, (int)std::thread::hardware_concurrency());
-const int MAX_CV_THREADS = std::max(2, (int)std::thread::hardware_concurrency());
+void autotune_thread_fn() {
+    auto last = std::chrono::steady_clock::now();
+    while (!g_autotune_stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        if (elapsed < AUTOTUNE_INTERVAL) continue;
+        last = now;
+        g_render_stage.tune(elapsed);
+        g_cv_stage.tune(elapsed);
+    }
+}
 
 static void clear_status_cb(void*) {
     if (status_box) {
@@ -95,6 +294,49 @@ int call(std::string c) {
     return system(buffer.c_str());
 };
 
+// ==========================================
+// Detection Module (Lazy Loading)
+// ==========================================
+// OpenCV, Tesseract and the page store live in docimg_cv.so (cv_engine.cpp),
+// next to the executable or at DOCIMG_CV_MODULE. It is only loaded by the
+// first run that asks for detection, so plain extraction starts without
+// mapping those libraries and works on hosts that do not have them.
+
+const CvEngine* g_cv = nullptr;
+std::mutex g_cv_mutex;
+
+std::string cv_module_path() {
+    const char* env = getenv("DOCIMG_CV_MODULE");
+    if (env && *env) return env;
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) return "./docimg_cv.so";
+    std::string path(exe, n);
+    return path.substr(0, path.find_last_of('/') + 1) + "docimg_cv.so";
+}
+
+// Safe to call from any thread; reports the reason on stderr if it fails
+bool load_cv_engine() {
+    std::lock_guard<std::mutex> lock(g_cv_mutex);
+    if (g_cv) return true;
+
+    std::string path = cv_module_path();
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::cerr << "[cv] " << dlerror() << std::endl;
+        return false;
+    }
+    auto entry = (const CvEngine* (*)())dlsym(handle, DOCIMG_CV_ENTRY);
+    const CvEngine* engine = entry ? entry() : nullptr;
+    if (!engine || engine->abi != CV_ENGINE_ABI) {
+        std::cerr << "[cv] " << path << " does not match this build" << std::endl;
+        dlclose(handle);
+        return false;
+    }
+    g_cv = engine;
+    return true;
+}
+
 // ==========================================
 // Dependency Checking
 // ==========================================
@@ -160,18 +402,55 @@ int check_dependencies() {
         }
     }
 
-    // Check: OpenCV
+    // Check: pdftohtml (embedded image placement)
+    {
+        int res = call("pdftohtml -v");
+        if (res == 0) {
+            support_PDF_PLACEMENT = true;
+        } else {
+            l->insert("pdftohtml not found - embedded PDF images will go through detection\n");
+        }
+    }
+
+    // Check: qpdf (form XObject placement)
+    {
+        int res = call("qpdf --version");
+        if (res == 0) {
+            support_QPDF = true;
+        } else {
+            l->insert("qpdf not found - PDF vector figures will go through detection\n");
+        }
+    }
+
+    // Check: pdftocairo (vector figure crops)
     {
-        int res = call("pkg-config --exists opencv4");
+        int res = call("pdftocairo -v");
         if (res == 0) {
+            support_PDF_VECTOR = true;
+        } else {
+            l->insert("pdftocairo not found - PDF figures will be saved as PNG only\n");
+            if (vector_toggle) {
+                vector_toggle->deactivate();
+                vector_toggle->value(0);
+            }
+        }
+    }
+
+    // Check: OpenCV (the detection module; loaded when a run needs it)
+    {
+        if (access(cv_module_path().c_str(), R_OK) == 0) {
             support_OPENCV = true;
-            l->insert("OpenCV found\n");
+            l->insert("OpenCV module found\n");
         } else {
-            l->insert("OpenCV not found - advanced figure extraction disabled\n");
+            l->insert("docimg_cv.so not found - advanced figure extraction disabled\n");
             if (opencv_toggle) {
                 opencv_toggle->deactivate();
                 opencv_toggle->value(0);
             }
+            if (seen_toggle) {
+                seen_toggle->deactivate();
+                seen_toggle->value(0);
+            }
         }
     }
 
@@ -212,292 +491,831 @@ void check_deps(void* user_data) {
     }
 }
 
+// pdftoppm names pages "<prefix>-<n>.png" with a zero-padded page number
+// (ddjvu pages here are "page_<n>.tif")
+int page_number_from_filename(const std::string& image_path) {
+    std::string name = image_path.substr(image_path.find_last_of('/') + 1);
+    // Rendered pages and anything named after them (page-0003_figure_2.png):
+    // the number right after the page prefix, not the last one in the name
+    if (name.compare(0, 5, "page-") == 0 || name.compare(0, 5, "page_") == 0) {
+        return isdigit((unsigned char)name[5]) ? atoi(name.c_str() + 5) : 0;
+    }
+    size_t last_dash = name.find_last_of("-_");
+    size_t last_dot = name.find_last_of('.');
+    if (last_dash == std::string::npos || last_dot == std::string::npos || last_dot <= last_dash + 1) return 0;
+    return atoi(name.substr(last_dash + 1, last_dot - last_dash - 1).c_str());
+}
+
 // ==========================================
-// OpenCV & Tesseract Logic
+// Embedded Image Placement (PDF)
 // ==========================================
+// pdftohtml -xml reports where every raster image is drawn on each page and
+// dumps the image itself at native resolution. Those regions are accepted as
+// figures directly and masked out, so detection only has to find vector art.
+double xml_attr(const std::string& tag, const std::string& name) {
+    std::string key = " " + name + "=\"";
+    size_t pos = tag.find(key);
+    if (pos == std::string::npos) return 0;
+    return atof(tag.c_str() + pos + key.size());
+}
 
-struct FigureCandidate {
-    cv::Rect bbox;
-    double textDensity;
-    double area;
-};
+std::string xml_attr_str(const std::string& tag, const std::string& name) {
+    std::string key = " " + name + "=\"";
+    size_t pos = tag.find(key);
+    if (pos == std::string::npos) return "";
+    pos += key.size();
+    size_t end = tag.find('"', pos);
+    if (end == std::string::npos) return "";
+    return tag.substr(pos, end - pos);
+}
 
-double calculateTextDensity(const cv::Mat& region) {
-    cv::Mat gray, binary;
-    if (region.channels() == 3) {
-        cv::cvtColor(region, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = region.clone();
+// Parse pdftohtml -xml output; image paths are resolved against temp_dir
+// and images whose files are missing are dropped
+std::map<int, PagePlacements> parse_placed_images(std::istream& xml, const std::string& temp_dir) {
+    std::map<int, PagePlacements> placements;
+    std::string line;
+    int page = 0;
+    while (std::getline(xml, line)) {
+        size_t tag = line.find("<page ");
+        if (tag != std::string::npos) {
+            page = (int)xml_attr(line.substr(tag), "number");
+            placements[page].width = xml_attr(line.substr(tag), "width");
+            placements[page].height = xml_attr(line.substr(tag), "height");
+            continue;
+        }
+        tag = line.find("<image ");
+        if (tag == std::string::npos || page <= 0) continue;
+
+        std::string image_tag = line.substr(tag);
+        PlacedImage img;
+        img.left = xml_attr(image_tag, "left");
+        img.top = xml_attr(image_tag, "top");
+        img.width = xml_attr(image_tag, "width");
+        img.height = xml_attr(image_tag, "height");
+        img.path = xml_attr_str(image_tag, "src");
+
+        struct stat st;
+        if (stat(img.path.c_str(), &st) != 0) {
+            img.path = temp_dir + "/" + img.path.substr(img.path.find_last_of('/') + 1);
+        }
+        if (stat(img.path.c_str(), &st) == 0) {
+            placements[page].images.push_back(img);
+        }
     }
-    
-    cv::adaptiveThreshold(gray, binary, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C,
-                          cv::THRESH_BINARY_INV, 15, 10);
-    
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-    cv::morphologyEx(binary, binary, cv::MORPH_CLOSE, kernel);
-    
-    cv::Mat labels, stats, centroids;
-    int numComponents = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8);
-    
-    int textLikeComponents = 0;
-    for (int i = 1; i < numComponents; i++) {
-        int width = stats.at<int>(i, cv::CC_STAT_WIDTH);
-        int height = stats.at<int>(i, cv::CC_STAT_HEIGHT);
-        int area = stats.at<int>(i, cv::CC_STAT_AREA);
-        
-        if (height > 5 && height < 50 && width > 3 && width < 200) {
-            double aspectRatio = (double)width / height;
-            if (aspectRatio > 0.2 && aspectRatio < 10 && area > 20) {
-                textLikeComponents++;
+    return placements;
+}
+
+std::map<int, PagePlacements> collect_placed_images(const std::string& pdf_path, const std::string& temp_dir) {
+    mkdir(temp_dir.c_str(), 0777);
+
+    std::string prefix = temp_dir + "/doc";
+    std::string cmd = "pdftohtml -xml -zoom 1 -q -nodrm '" + pdf_path + "' '" + prefix + "' > /dev/null 2>&1";
+    run_command(cmd.c_str());
+
+    std::ifstream xml(prefix + ".xml");
+    return parse_placed_images(xml, temp_dir);
+}
+
+// ==========================================
+// Form XObject Placement (PDF)
+// ==========================================
+// LaTeX and Office put most vector figures in Form XObjects with a known
+// BBox and Matrix. qpdf --qdf rewrites the PDF with every stream decoded and
+// pages marked, which is simple enough to read here: each page's content
+// stream is walked for q/Q/cm and "Do", and the forms it draws get their
+// on-page box. Those boxes are taken as figures directly and masked out, so
+// detection only sees what is left.
+
+struct PdfObject {
+    std::string dict;
+    size_t stream_pos = std::string::npos; // Offset of the stream data in the file
+    size_t stream_len = 0;
+};
+
+// Value of /key in a dictionary: a <<dict>>, [array], "N 0 R" or single token
+static std::string pdf_dict_get(const std::string& dict, const std::string& key) {
+    std::string k = "/" + key;
+    size_t pos = 0;
+    while ((pos = dict.find(k, pos)) != std::string::npos) {
+        pos += k.size();
+        if (pos < dict.size() && (isalnum((unsigned char)dict[pos]) || dict[pos] == '_')) continue;
+        while (pos < dict.size() && isspace((unsigned char)dict[pos])) pos++;
+        if (dict.compare(pos, 2, "<<") == 0 || dict[pos] == '[') {
+            bool is_dict = dict[pos] == '<';
+            int depth = 0;
+            size_t end = pos;
+            for (; end < dict.size(); end++) {
+                if (is_dict && dict.compare(end, 2, "<<") == 0) { depth++; end++; }
+                else if (is_dict && dict.compare(end, 2, ">>") == 0) { if (--depth == 0) { end += 2; break; } end++; }
+                else if (!is_dict && dict[end] == '[') depth++;
+                else if (!is_dict && dict[end] == ']' && --depth == 0) { end++; break; }
             }
+            return dict.substr(pos, end - pos);
         }
+        size_t end = dict.find_first_of("/>]\n", pos + 1);
+        std::string value = dict.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        while (!value.empty() && isspace((unsigned char)value.back())) value.pop_back();
+        return value;
     }
-    
-    return (double)textLikeComponents / (region.rows * region.cols) * 10000;
+    return "";
 }
 
-bool hasGraphicalContent(const cv::Mat& region) {
-    cv::Mat gray, edges;
-    if (region.channels() == 3) {
-        cv::cvtColor(region, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = region.clone();
-    }
-    
-    cv::Canny(gray, edges, 50, 150);
-    int edgePixels = cv::countNonZero(edges);
-    double edgeDensity = (double)edgePixels / (region.rows * region.cols);
-    
-    return edgeDensity > 0.005 && edgeDensity < 0.15;
+static std::vector<double> pdf_numbers(const std::string& array) {
+    std::vector<double> out;
+    std::istringstream in(array.substr(array.find('[') + 1));
+    double v;
+    while (in >> v) out.push_back(v);
+    return out;
 }
 
-int countWords(const std::string& text) {
-    std::stringstream ss(text);
-    std::string word;
-    int count = 0;
-    while (ss >> word) count++;
-    return count;
+// Follow "N 0 R" to the object's dictionary; direct values are returned as is
+static std::string pdf_resolve(const std::map<int, PdfObject>& objects, const std::string& value) {
+    if (value.size() < 5 || value.compare(value.size() - 1, 1, "R") != 0) return value;
+    auto it = objects.find(atoi(value.c_str()));
+    return it == objects.end() ? "" : it->second.dict;
 }
 
-bool isTextBlock(tesseract::TessBaseAPI* tess, const cv::Mat& region, std::string& extractedTextOut) {
-    if (!tess) return false;
+static std::string pdf_stream(const std::string& file, const std::map<int, PdfObject>& objects, int id) {
+    auto it = objects.find(id);
+    if (it == objects.end() || it->second.stream_pos == std::string::npos) return "";
+    return file.substr(it->second.stream_pos, it->second.stream_len);
+}
 
-    cv::Mat gray;
-    if (region.channels() == 3) {
-        cv::cvtColor(region, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = region;
+// Split a content stream into operands and operators; strings, hex strings
+// and inline images are skipped
+static std::vector<std::string> pdf_tokens(const std::string& content) {
+    std::vector<std::string> tokens;
+    size_t i = 0, n = content.size();
+    while (i < n) {
+        char c = content[i];
+        if (isspace((unsigned char)c)) { i++; continue; }
+        if (c == '%') { while (i < n && content[i] != '\n') i++; continue; }
+        if (c == '(') {
+            int depth = 0;
+            for (; i < n; i++) {
+                if (content[i] == '\\') { i++; continue; }
+                if (content[i] == '(') depth++;
+                else if (content[i] == ')' && --depth == 0) { i++; break; }
+            }
+            tokens.push_back("()");
+            continue;
+        }
+        if (c == '<' && i + 1 < n && content[i + 1] != '<') {
+            i = content.find('>', i);
+            i = (i == std::string::npos) ? n : i + 1;
+            tokens.push_back("<>");
+            continue;
+        }
+        if (c == '[' || c == ']' || c == '{' || c == '}') { tokens.push_back(std::string(1, c)); i++; continue; }
+        if (content.compare(i, 2, "<<") == 0 || content.compare(i, 2, ">>") == 0) { tokens.push_back(content.substr(i, 2)); i += 2; continue; }
+
+        size_t start = i++;
+        while (i < n && !isspace((unsigned char)content[i]) && !strchr("()<>[]{}/%", content[i])) i++;
+        tokens.push_back(content.substr(start, i - start));
+        if (tokens.back() == "ID") {
+            size_t end = content.find("EI", i);
+            while (end != std::string::npos && end + 2 < n && !isspace((unsigned char)content[end + 2])) {
+                end = content.find("EI", end + 2);
+            }
+            i = (end == std::string::npos) ? n : end + 2;
+        }
     }
+    return tokens;
+}
 
-    tess->SetImage(gray.data, gray.cols, gray.rows, 1, gray.step);
-    
-    int conf = tess->MeanTextConf();
-    char* text = tess->GetUTF8Text();
-    std::string strText(text);
-    delete[] text; 
-    
-    extractedTextOut = strText;
-    int wordCount = countWords(strText);
-    
-    if (conf > 70 && wordCount > 25) {
-        return true;
+// True when a form paints paths, images or shadings (not just text). Path
+// construction alone paints nothing: a path ended with n (often a clip) or
+// never painted does not count, only the stroke and fill operators do.
+static bool pdf_form_draws(const std::string& content) {
+    static const char* PAINT_OPS[] = {"S", "s", "f", "F", "f*", "B", "B*", "b", "b*", "Do", "sh", "BI"};
+    for (const auto& tok : pdf_tokens(content)) {
+        for (const char* op : PAINT_OPS) {
+            if (tok == op) return true;
+        }
     }
-    
     return false;
 }
 
-bool isLikelyPureTextCV(double textDensity) {
-    if (textDensity > 10.0) return true; 
-    return false;
+typedef std::array<double, 6> PdfMatrix; // a b c d e f
+
+static PdfMatrix pdf_concat(const PdfMatrix& m, const PdfMatrix& ctm) {
+    return {m[0] * ctm[0] + m[1] * ctm[2], m[0] * ctm[1] + m[1] * ctm[3],
+            m[2] * ctm[0] + m[3] * ctm[2], m[2] * ctm[1] + m[3] * ctm[3],
+            m[4] * ctm[0] + m[5] * ctm[2] + ctm[4], m[4] * ctm[1] + m[5] * ctm[3] + ctm[5]};
 }
 
-std::vector<cv::Rect> extractFigures(const cv::Mat& image, tesseract::TessBaseAPI* tess, bool useOCR) {
-    std::vector<cv::Rect> figures;
-    
-    cv::Mat gray, binary;
-    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-    
-    cv::adaptiveThreshold(gray, binary, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C,
-                          cv::THRESH_BINARY_INV, 25, 15);
-    
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-    cv::dilate(binary, binary, kernel, cv::Point(-1, -1), 3);
-    
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-    
-    std::vector<FigureCandidate> candidates;
-    
-    double minArea = image.rows * image.cols * 0.01;
-    double maxArea = image.rows * image.cols * 0.7;
-    
-    for (const auto& contour : contours) {
-        cv::Rect bbox = cv::boundingRect(contour);
-        double area = bbox.width * bbox.height;
-        
-        if (area < minArea || area > maxArea) continue;
-        if (bbox.width < 100 || bbox.height < 100) continue;
-        
-        int padX = (int)(bbox.width * 0.05);
-        int padY = (int)(bbox.height * 0.05);
+// A PDF rewritten by qpdf in QDF mode and indexed by object and page
+struct QdfDocument {
+    std::string file;
+    std::map<int, PdfObject> objects;
+    std::map<int, int> page_objects; // Page number -> object id
+};
+
+// Index the objects and pages of qdf.file; QDF puts "%% Page N" before each
+// page object. False when no page was found.
+bool index_qdf(QdfDocument& qdf) {
+    const std::string& file = qdf.file;
+    qdf.objects.clear();
+    qdf.page_objects.clear();
+    int pending_page = 0;
+    size_t pos = 0;
+    while (pos < file.size()) {
+        size_t eol = file.find('\n', pos);
+        if (eol == std::string::npos) eol = file.size();
+        std::string line = file.substr(pos, eol - pos);
+        if (line.compare(0, 8, "%% Page ") == 0) {
+            pending_page = atoi(line.c_str() + 8);
+        } else if (line.size() > 6 && line.compare(line.size() - 6, 6, " 0 obj") == 0 && isdigit((unsigned char)line[0])) {
+            int id = atoi(line.c_str());
+            size_t end = file.find("\nendobj", eol);
+            if (end == std::string::npos) break;
+            PdfObject& obj = qdf.objects[id];
+            size_t stream = file.find("\nstream\n", eol);
+            if (stream != std::string::npos && stream < end) {
+                obj.dict = file.substr(eol + 1, stream - eol - 1);
+                obj.stream_pos = stream + 8;
+                size_t stream_end = file.rfind("\nendstream", end);
+                obj.stream_len = (stream_end != std::string::npos && stream_end >= obj.stream_pos) ? stream_end - obj.stream_pos : 0;
+            } else {
+                obj.dict = file.substr(eol + 1, end - eol - 1);
+            }
+            if (pending_page > 0 && obj.dict.find("/Type /Page") != std::string::npos) {
+                qdf.page_objects[pending_page] = id;
+                pending_page = 0;
+            }
+            eol = end + 7;
+        }
+        pos = eol + 1;
+    }
+    return !qdf.page_objects.empty();
+}
 
-        int x = bbox.x - padX;
-        int y = bbox.y - padY;
+bool load_qdf(const std::string& pdf_path, const std::string& temp_dir, QdfDocument& qdf) {
+    mkdir(temp_dir.c_str(), 0777);
+    std::string qdf_path = temp_dir + "/doc.qdf";
+    std::string cmd = "qpdf --qdf --object-streams=disable '" + pdf_path + "' '" + qdf_path + "' > /dev/null 2>&1";
+    run_command(cmd.c_str());
+
+    std::ifstream in(qdf_path, std::ios::binary);
+    std::string& file = qdf.file;
+    file.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    unlink(qdf_path.c_str());
+    return index_qdf(qdf);
+}
 
-        if (x < 0) x = 0;
-        if (y < 0) y = 0;
+// Page attribute, inherited from the page tree when the page leaves it out
+// (Resources, MediaBox, CropBox and Rotate may sit on a /Pages node)
+static std::string pdf_page_attr(const QdfDocument& qdf, const std::string& page_dict, const char* key) {
+    std::string dict = page_dict;
+    for (int depth = 0; depth < 64 && !dict.empty(); depth++) {
+        std::string value = pdf_dict_get(dict, key);
+        if (!value.empty()) return value;
+        dict = pdf_resolve(qdf.objects, pdf_dict_get(dict, "Parent"));
+    }
+    return "";
+}
 
-        int width = bbox.width + 2 * padX;
-        int height = bbox.height + 2 * padY;
+// Decoded content streams of a page, concatenated
+static std::string pdf_page_content(const QdfDocument& qdf, const std::string& page_dict) {
+    std::string content;
+    std::string contents = pdf_dict_get(page_dict, "Contents");
+    std::istringstream refs(!contents.empty() && contents[0] == '[' ? contents.substr(1) : contents);
+    int id, gen;
+    std::string r;
+    while (refs >> id >> gen >> r) content += pdf_stream(qdf.file, qdf.objects, id) + "\n";
+    return content;
+}
 
-        if (x + width > image.cols) width = image.cols - x;
-        if (y + height > image.rows) height = image.rows - y;
-        
-        cv::Rect paddedBox(x, y, width, height);
-        cv::Mat region = image(paddedBox);
-        double textDensity = calculateTextDensity(region);
-        
-        candidates.push_back({paddedBox, textDensity, area});
+// Box (left, top, width, height) on an unrotated w x h page, moved to where
+// it lands once the page is shown turned clockwise by rotate degrees
+static PlacedForm pdf_rotate_box(const PlacedForm& r, int rotate, double w, double h) {
+    switch (rotate) {
+        case 90:  return {h - r.top - r.height, r.left, r.height, r.width};
+        case 180: return {w - r.left - r.width, h - r.top - r.height, r.width, r.height};
+        case 270: return {r.top, w - r.left - r.width, r.height, r.width};
+        default:  return r;
     }
-    
-    std::sort(candidates.begin(), candidates.end(),
-         [](const FigureCandidate& a, const FigureCandidate& b) {
-             return a.area > b.area;
-         });
-    
-    for (const auto& candidate : candidates) {
-        cv::Mat region = image(candidate.bbox);
-        bool hasGraphics = hasGraphicalContent(region);
-        
-        if (candidate.textDensity > 20.0) {
-            if (hasGraphics) {
-                figures.push_back(candidate.bbox);
-            }
-            continue;
-        }
+}
 
-        if (candidate.textDensity < 2.0) {
-            figures.push_back(candidate.bbox);
+void collect_form_xobjects(const QdfDocument& qdf, std::map<int, PagePlacements>& placements) {
+    const std::string& file = qdf.file;
+    const std::map<int, PdfObject>& objects = qdf.objects;
+    static const PdfObject none;
+    auto object = [&](int id) -> const PdfObject& {
+        auto it = objects.find(id);
+        return it == objects.end() ? none : it->second;
+    };
+
+    for (const auto& entry : qdf.page_objects) {
+        int page = entry.first;
+        const std::string& page_dict = object(entry.second).dict;
+        // Boxes are found in unrotated page space and turned like the render
+        int rotate = ((atoi(pdf_page_attr(qdf, page_dict, "Rotate").c_str()) % 360) + 360) % 360;
+        if (rotate % 90 != 0) {
+            std::cerr << "[forms] page " << page << " has /Rotate " << rotate
+                      << ", leaving its figures to contour detection" << std::endl;
             continue;
         }
 
-        if (isLikelyPureTextCV(candidate.textDensity)) {
-            continue; 
-        }
+        const char* box_key = pdf_page_attr(qdf, page_dict, "CropBox").empty() ? "MediaBox" : "CropBox";
+        std::vector<double> page_box = pdf_numbers(pdf_resolve(objects, pdf_page_attr(qdf, page_dict, box_key)));
+        if (page_box.size() != 4) continue;
 
-        std::string ocrTextResult = "";
-        bool isTextBlockByOCR = false;
-        
-        if (useOCR && tess) {
-             isTextBlockByOCR = isTextBlock(tess, region, ocrTextResult);
-        }
+        std::string resources = pdf_resolve(objects, pdf_page_attr(qdf, page_dict, "Resources"));
+        std::string xobjects = pdf_resolve(objects, pdf_dict_get(resources, "XObject"));
+        if (xobjects.empty()) continue;
 
-        if (isTextBlockByOCR) {
-            continue; 
+        std::string content = pdf_page_content(qdf, page_dict);
+
+        double page_w = page_box[2] - page_box[0], page_h = page_box[3] - page_box[1];
+        bool quarter_turn = rotate == 90 || rotate == 270;
+        PagePlacements& placed = placements[page];
+        if (placed.width <= 0) {
+            placed.width = quarter_turn ? page_h : page_w;
+            placed.height = quarter_turn ? page_w : page_h;
         }
-        
-        if (hasGraphics) {
-            figures.push_back(candidate.bbox);
+
+        std::vector<PdfMatrix> stack;
+        PdfMatrix ctm = {1, 0, 0, 1, 0, 0};
+        std::vector<std::string> tokens = pdf_tokens(content);
+        for (size_t t = 0; t < tokens.size(); t++) {
+            const std::string& op = tokens[t];
+            if (op == "q") stack.push_back(ctm);
+            else if (op == "Q" && !stack.empty()) { ctm = stack.back(); stack.pop_back(); }
+            else if (op == "cm" && t >= 6) {
+                PdfMatrix m;
+                for (int k = 0; k < 6; k++) m[k] = atof(tokens[t - 6 + k].c_str());
+                ctm = pdf_concat(m, ctm);
+            }
+            else if (op == "Do" && t >= 1 && tokens[t - 1][0] == '/') {
+                std::string ref = pdf_dict_get(xobjects, tokens[t - 1].substr(1));
+                if (ref.empty() || ref.back() != 'R') continue;
+                int form_id = atoi(ref.c_str());
+                const std::string& form = object(form_id).dict;
+                if (pdf_dict_get(form, "Subtype") != "/Form") continue;
+                std::vector<double> bbox = pdf_numbers(pdf_dict_get(form, "BBox"));
+                if (bbox.size() != 4 || !pdf_form_draws(pdf_stream(file, objects, form_id))) continue;
+
+                PdfMatrix m = {1, 0, 0, 1, 0, 0};
+                std::vector<double> matrix = pdf_numbers(pdf_dict_get(form, "Matrix"));
+                if (matrix.size() == 6) std::copy(matrix.begin(), matrix.end(), m.begin());
+                PdfMatrix full = pdf_concat(m, ctm);
+
+                double x0 = 1e9, y0 = 1e9, x1 = -1e9, y1 = -1e9;
+                for (int corner = 0; corner < 4; corner++) {
+                    double x = bbox[(corner & 1) ? 2 : 0], y = bbox[(corner & 2) ? 3 : 1];
+                    double px = full[0] * x + full[2] * y + full[4];
+                    double py = full[1] * x + full[3] * y + full[5];
+                    x0 = std::min(x0, px); x1 = std::max(x1, px);
+                    y0 = std::min(y0, py); y1 = std::max(y1, py);
+                }
+                placed.forms.push_back(pdf_rotate_box({x0 - page_box[0], page_box[3] - y1, x1 - x0, y1 - y0},
+                                                      rotate, page_w, page_h));
+            }
         }
     }
-    
-    return figures;
-}
-
-// Process a single image file (Thread Safe)
-void process_single_image(const std::string& image_path, const std::string& output_folder, bool use_tesseract) {
-    // Initialize Tesseract locally for this thread
-    tesseract::TessBaseAPI* tess = nullptr;
-    if (use_tesseract && support_TESSERACT) {
-        tess = new tesseract::TessBaseAPI();
-        if (tess->Init(NULL, "eng")) {
-            delete tess;
-            tess = nullptr;
+}
+
+// ==========================================
+// Page Fingerprints (Incremental Re-runs)
+// ==========================================
+// A page's fingerprint hashes what its rendering depends on. For PDF that is
+// the page geometry, the decoded content stream and every object reachable
+// from its annotations, transparency group and resources, with object numbers
+// stripped since they change between editions. For DjVu it is the page component plus the shared components
+// pages include. Fingerprints are stored with the outputs; re-running a
+// revised document renders and detects only pages with a new fingerprint and
+// moves the earlier outputs of the others to their (possibly new) page names.
+
+const char* PAGE_FINGERPRINT_FILE = "page_fingerprints.txt";
+const char* REUSED_PAGES_DIR = "_reused_pages";
+
+static uint64_t fnv1a(const std::string& data, uint64_t hash = 1469598103934665603ULL) {
+    for (unsigned char c : data) hash = (hash ^ c) * 1099511628211ULL;
+    return hash;
+}
+
+static std::string hex64(uint64_t value) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+    return buf;
+}
+
+// Object text with "N G R" references replaced by "R"; the ids go to refs
+static std::string pdf_strip_refs(const std::string& text, std::vector<int>& refs) {
+    std::string out;
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t j = i;
+        while (j < text.size() && isdigit((unsigned char)text[j])) j++;
+        size_t k = j;
+        if (j > i && k < text.size() && text[k] == ' ') {
+            k++;
+            size_t gen = k;
+            while (k < text.size() && isdigit((unsigned char)text[k])) k++;
+            if (k > gen && k + 1 < text.size() && text[k] == ' ' && text[k + 1] == 'R' &&
+                (k + 2 == text.size() || !isalnum((unsigned char)text[k + 2])) &&
+                (i == 0 || !isdigit((unsigned char)text[i - 1]))) {
+                refs.push_back(atoi(text.c_str() + i));
+                out += 'R';
+                i = k + 2;
+                continue;
+            }
+        }
+        if (j > i) {
+            out.append(text, i, j - i);
+            i = j;
         } else {
-            tess->SetPageSegMode(tesseract::PSM_AUTO);
+            out += text[i++];
         }
     }
+    return out;
+}
 
-    cv::Mat image = cv::imread(image_path, cv::IMREAD_COLOR);
-    if (!image.empty()) {
-        std::vector<cv::Rect> figures = extractFigures(image, tess, (tess != nullptr));
+// Hash an object, its stream and everything it references (except the page tree)
+static void pdf_hash_closure(const QdfDocument& qdf, const std::string& text, std::set<int>& seen, uint64_t& hash) {
+    std::vector<int> refs;
+    hash = fnv1a(pdf_strip_refs(text, refs), hash);
+    for (int id : refs) {
+        auto it = qdf.objects.find(id);
+        if (it == qdf.objects.end() || !seen.insert(id).second) continue;
+        const PdfObject& obj = it->second;
+        if (pdf_dict_get(obj.dict, "Type") == "/Page" || pdf_dict_get(obj.dict, "Type") == "/Pages") continue;
+        pdf_hash_closure(qdf, obj.dict, seen, hash);
+        if (obj.stream_pos != std::string::npos) hash = fnv1a(qdf.file.substr(obj.stream_pos, obj.stream_len), hash);
+    }
+}
 
-        size_t last_slash = image_path.find_last_of("/\\");
-        size_t last_dot = image_path.find_last_of(".");
-        std::string base_name = image_path.substr(last_slash + 1, last_dot - last_slash - 1);
+// By page - 1; empty when the page list is incomplete
+std::vector<std::string> pdf_page_fingerprints(const QdfDocument& qdf) {
+    std::vector<std::string> fingerprints;
+    for (const auto& entry : qdf.page_objects) {
+        if (entry.first != (int)fingerprints.size() + 1) return {};
+        const std::string& page_dict = qdf.objects.at(entry.second).dict;
+
+        // Inherited attributes are hashed as if the page set them itself
+        uint64_t hash = fnv1a("pdf");
+        for (const char* key : {"MediaBox", "CropBox", "Rotate"}) {
+            hash = fnv1a(pdf_resolve(qdf.objects, pdf_page_attr(qdf, page_dict, key)) + ";", hash);
+        }
+        hash = fnv1a(pdf_resolve(qdf.objects, pdf_dict_get(page_dict, "UserUnit")) + ";", hash);
+        hash = fnv1a(pdf_page_content(qdf, page_dict), hash);
+        std::set<int> seen;
+        pdf_hash_closure(qdf, pdf_page_attr(qdf, page_dict, "Resources"), seen, hash);
+        // Annotation appearances and the transparency group render too (an
+        // annotation's /P back to the page is cut off with the page tree).
+        // Pages without them keep the fingerprints earlier runs stored.
+        for (const char* key : {"Annots", "Group"}) pdf_hash_closure(qdf, pdf_dict_get(page_dict, key), seen, hash);
+        fingerprints.push_back(hex64(hash));
+    }
+    return fingerprints;
+}
 
-        std::string opencv_folder = output_folder + "/opencv_figures";
-        mkdir(opencv_folder.c_str(), 0777);
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
 
-        for (size_t i = 0; i < figures.size(); i++) {
-            cv::Mat figure = image(figures[i]);
-            std::string output_path = opencv_folder + "/" + base_name + "_figure_" + std::to_string(i+1) + ".png";
-            cv::imwrite(output_path, figure);
+// By page - 1; empty when the document cannot be split into components
+std::vector<std::string> djvu_page_fingerprints(const std::string& djvu_path, const std::string& temp_dir) {
+    std::string dir = temp_dir + "/djvu_components";
+    mkdir(temp_dir.c_str(), 0777);
+    mkdir(dir.c_str(), 0777);
+    std::string cmd = "djvmcvt -i '" + djvu_path + "' '" + dir + "' index.djvu > /dev/null 2>&1";
+    bool split = run_command(cmd.c_str()) == 0;
+
+    // "ls" lists components in order: "  <page> P <size> <id>" or "  I <size> <id>"
+    std::vector<std::string> page_ids;
+    std::vector<std::string> shared_ids;
+    cmd = "djvused -e 'ls' '" + djvu_path + "' 2> /dev/null";
+    FILE* pipe = split ? open_command(cmd.c_str(), "r") : nullptr;
+    if (pipe) {
+        char buffer[1024];
+        while (fgets(buffer, sizeof(buffer), pipe)) {
+            std::istringstream line(buffer);
+            std::string first, type, size, id;
+            line >> first;
+            if (isdigit((unsigned char)first[0])) line >> type >> size >> id;
+            else { type = first; line >> size >> id; }
+            if (id.empty()) continue;
+            if (type == "P") page_ids.push_back(id);
+            else if (type == "I") shared_ids.push_back(id);
         }
+        pclose(pipe);
     }
 
-    if (tess) {
-        tess->End();
-        delete tess;
+    std::vector<std::string> fingerprints;
+    uint64_t shared = fnv1a("djvu");
+    std::sort(shared_ids.begin(), shared_ids.end());
+    for (const auto& id : shared_ids) shared = fnv1a(read_file(dir + "/" + id), shared);
+    for (const auto& id : page_ids) {
+        std::string data = read_file(dir + "/" + id);
+        if (data.empty()) {
+            fingerprints.clear();
+            break;
+        }
+        fingerprints.push_back(hex64(fnv1a(data, shared)));
     }
 
-    // Atomic Increment
-    g_processed_work_units++;
+    std::string rm = "rm -rf '" + dir + "'";
+    run_command(rm.c_str());
+    return fingerprints;
+}
+
+// The names the render step gives page files (and figure files start with)
+std::string rendered_page_name(const std::string& ftype, int page, int pages) {
+    std::stringstream ss;
+    if (ftype == "djvu") ss << "page_" << std::setw(4) << std::setfill('0') << page;
+    else ss << "page-" << std::setw((int)std::to_string(pages).size()) << std::setfill('0') << page;
+    return ss.str();
 }
 
-void process_extracted_images_with_opencv(const std::string& folder_path, bool use_tesseract) {
-    std::vector<std::string> image_files;
-    DIR* dir;
-    struct dirent* entry;
+// Output options that change what is written for a page; earlier outputs
+// made with other options are not reused
+static std::string page_output_settings() {
+    return std::string("# ocr=") + (g_use_tesseract ? "1" : "0") + " vector=" + (g_vector_figures ? "1" : "0") +
+           " xycut=" + (g_layout_engine == LayoutEngine::XYCut ? "1" : "0") +
+           " sauvola=" + (g_binarizer == Binarizer::Sauvola ? "1" : "0");
+}
 
-    if ((dir = opendir(folder_path.c_str())) != nullptr) {
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string filename = entry->d_name;
-            if (filename.size() > 4 &&
-                (filename.substr(filename.size()-4) == ".png" ||
-                 filename.substr(filename.size()-4) == ".jpg" ||
-                 filename.substr(filename.size()-4) == ".tif" ||
-                 filename.substr(filename.size()-5) == ".jpeg")) {
-                image_files.push_back(folder_path + "/" + filename);
+struct IncrementalRun {
+    std::string folder;
+    std::vector<std::string> fingerprints; // By page - 1
+    std::vector<std::string> names;        // By page - 1
+    std::vector<bool> todo;                // By page (0 unused); empty: all pages
+
+    // Link the earlier outputs of unchanged pages aside under their new names,
+    // then delete all earlier page outputs
+    void plan(const std::string& target_folder, const std::string& ftype, const std::vector<std::string>& prints, int pages) {
+        if (prints.empty() || (int)prints.size() != pages) return;
+        folder = target_folder;
+        fingerprints = prints;
+        for (int page = 1; page <= pages; page++) names.push_back(rendered_page_name(ftype, page, pages));
+
+        // A run interrupted between plan() and finish() leaves the outputs it
+        // set aside in REUSED_PAGES_DIR, and they are the only copies (the
+        // earlier ones were deleted). Put them back; the list next to them
+        // says which pages they are.
+        std::string reuse = folder + "/" + REUSED_PAGES_DIR;
+        struct stat st;
+        bool interrupted = stat(reuse.c_str(), &st) == 0;
+        std::ifstream in(interrupted ? reuse + "/" + PAGE_FINGERPRINT_FILE : folder + "/" + PAGE_FINGERPRINT_FILE);
+        std::string settings;
+        std::getline(in, settings);
+
+        std::map<std::string, std::string> previous; // Fingerprint -> earlier page name
+        std::vector<std::string> previous_names;
+        int old_page;
+        std::string hash, name;
+        while (in >> old_page >> hash >> name) {
+            previous.emplace(hash, name);
+            previous_names.push_back(name);
+        }
+        in.close();
+        if (interrupted) put_back(folder);
+        if (settings != page_output_settings() || previous.empty()) return;
+
+        std::string opencv_folder = folder + "/opencv_figures";
+        mkdir(reuse.c_str(), 0777);
+        mkdir((reuse + "/opencv_figures").c_str(), 0777);
+        std::vector<std::string> page_files = list_files(folder);
+        std::vector<std::string> figure_files = list_files(opencv_folder);
+
+        todo.assign(pages + 1, true);
+        todo[0] = false;
+        int reused = 0;
+        std::ofstream set_aside(reuse + "/" + PAGE_FINGERPRINT_FILE);
+        set_aside << settings << "\n";
+        for (int page = 1; page <= pages; page++) {
+            auto match = previous.find(fingerprints[page - 1]);
+            if (match == previous.end()) continue;
+            const std::string& old_name = match->second;
+
+            // A page is only skipped if all of its outputs were linked
+            std::vector<std::string> linked;
+            bool complete = true;
+            auto keep = [&](const std::string& from, const std::string& to) {
+                if (link(from.c_str(), to.c_str()) == 0) linked.push_back(to);
+                else complete = false;
+            };
+            for (const auto& f : page_files) {
+                if (f.compare(0, old_name.size() + 1, old_name + ".") == 0) {
+                    keep(folder + "/" + f, reuse + "/" + names[page - 1] + f.substr(old_name.size()));
+                }
+            }
+            for (const auto& f : figure_files) {
+                if (f.compare(0, old_name.size() + 8, old_name + "_figure_") == 0) {
+                    keep(opencv_folder + "/" + f, reuse + "/opencv_figures/" + names[page - 1] + f.substr(old_name.size()));
+                }
             }
+            if (!complete) {
+                for (const auto& path : linked) unlink(path.c_str());
+                continue;
+            }
+            set_aside << page << " " << fingerprints[page - 1] << " " << names[page - 1] << "\n";
+            todo[page] = false;
+            reused++;
+        }
+        set_aside.close();
+
+        for (const auto& old_name : previous_names) {
+            for (const auto& f : page_files) {
+                if (f.compare(0, old_name.size() + 1, old_name + ".") == 0) unlink((folder + "/" + f).c_str());
+            }
+            for (const auto& f : figure_files) {
+                if (f.compare(0, old_name.size() + 8, old_name + "_figure_") == 0) unlink((opencv_folder + "/" + f).c_str());
+            }
+        }
+        g_processed_work_units += 2 * reused; // Render + detect, as estimated
+    }
+
+    // Move the reused outputs into place and record the new fingerprints
+    void finish() {
+        if (folder.empty()) return;
+        if (!todo.empty()) put_back(folder);
+
+        std::ofstream out(folder + "/" + PAGE_FINGERPRINT_FILE);
+        out << page_output_settings() << "\n";
+        for (size_t i = 0; i < fingerprints.size(); i++) out << (i + 1) << " " << fingerprints[i] << " " << names[i] << "\n";
+    }
+
+    // Move what REUSED_PAGES_DIR holds into the document folder, then remove it
+    static void put_back(const std::string& folder) {
+        std::string reuse = folder + "/" + REUSED_PAGES_DIR;
+        mkdir((folder + "/opencv_figures").c_str(), 0777);
+        for (const auto& f : list_files(reuse)) {
+            if (f != PAGE_FINGERPRINT_FILE) rename((reuse + "/" + f).c_str(), (folder + "/" + f).c_str());
+        }
+        for (const auto& f : list_files(reuse + "/opencv_figures")) {
+            rename((reuse + "/opencv_figures/" + f).c_str(), (folder + "/opencv_figures/" + f).c_str());
+        }
+        std::string rm = "rm -rf '" + reuse + "'";
+        run_command(rm.c_str());
+    }
+
+    static std::vector<std::string> list_files(const std::string& dir_path) {
+        std::vector<std::string> files;
+        DIR* dir = opendir(dir_path.c_str());
+        if (!dir) return files;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_type != DT_DIR) files.push_back(entry->d_name);
         }
         closedir(dir);
+        return files;
     }
+};
 
-    if (image_files.empty()) return;
+// ==========================================
+// Prefork Detection Workers (Crash Isolation)
+// ==========================================
+// A supervisor process is forked first thing in main(), while the program is
+// still small and single-threaded. On request it forks detection workers,
+// each owning one shared-memory page slot and its own Tesseract engine, and
+// reforks any worker that dies. Pages are copied into the slot once and the
+// figure boxes come back through it; a page that crashes its worker is
+// skipped instead of taking the whole batch down.
+
+struct PreforkCommand { int op; int workers; };
+enum { PREFORK_START = 1 };
+
+bool support_PREFORK = false;
+bool g_use_prefork = false;
+unsigned char* g_prefork_shm = nullptr;
+int g_prefork_cmd_fd = -1;
+pid_t g_prefork_supervisor = 0;
+
+std::mutex g_prefork_mutex;
+std::condition_variable g_prefork_cv;
+bool g_prefork_slot_busy[PREFORK_MAX_WORKERS] = {};
+int g_prefork_workers = 0;
+
+// The supervisor never loads the detection module, so it stays small; each
+// worker loads it after the fork
+const int PREFORK_EXIT_NO_ENGINE = 3; // Worker exit status: the module would not load
+
+static void prefork_worker_main(int index) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (!load_cv_engine()) _exit(PREFORK_EXIT_NO_ENGINE);
+    g_cv->prefork_serve(index);
+}
 
-    // Parallel vs Serial Processing Loop
-    std::vector<std::thread> threads;
-    int active_threads = 0;
+static void prefork_supervisor_main(int cmd_fd) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    pid_t pids[PREFORK_MAX_WORKERS] = {};
+    bool offline[PREFORK_MAX_WORKERS] = {};
+    int wanted = 0;
+
+    auto spawn = [&](int i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(cmd_fd);
+            prefork_worker_main(i);
+            _exit(0);
+        }
+        pids[i] = pid > 0 ? pid : 0;
+    };
+
+    while (true) {
+        struct pollfd pfd = {cmd_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0) {
+            PreforkCommand cmd;
+            if (read(cmd_fd, &cmd, sizeof(cmd)) != sizeof(cmd)) break; // GUI process is gone
+            if (cmd.op == PREFORK_START) {
+                wanted = std::min(cmd.workers, PREFORK_MAX_WORKERS);
+                for (int i = 0; i < wanted; i++) {
+                    if (pids[i] == 0 && !offline[i]) spawn(i);
+                }
+            }
+        }
 
-    for (const auto& image_path : image_files) {
-        if (g_use_multithreading) {
-            // Limit concurrency
-            while (active_threads >= MAX_CV_THREADS) {
-                for (auto& t : threads) {
-                    if (t.joinable()) {
-                        t.join();
-                        active_threads--;
-                    }
+        // Fail the page a dead worker was holding, then replace the worker.
+        // A worker that could not load the module is not replaced: a new one
+        // would fail the same way. Its slot goes offline, and pages sent to it
+        // are detected in the application process.
+        int status;
+        pid_t dead;
+        while ((dead = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int i = 0; i < PREFORK_MAX_WORKERS; i++) {
+                if (pids[i] != dead) continue;
+                pids[i] = 0;
+                bool no_engine = WIFEXITED(status) && WEXITSTATUS(status) == PREFORK_EXIT_NO_ENGINE;
+                PageSlot* slot = prefork_slot(i);
+                slot_lock(slot);
+                if (no_engine) {
+                    slot->state = SLOT_OFFLINE;
+                    pthread_cond_broadcast(&slot->cond);
+                } else if (slot->state == SLOT_REQUEST || slot->state == SLOT_BUSY) {
+                    slot->state = SLOT_FAILED;
+                    pthread_cond_broadcast(&slot->cond);
+                }
+                pthread_mutex_unlock(&slot->mutex);
+                if (no_engine) {
+                    offline[i] = true;
+                    std::cerr << "[prefork] worker " << i << " could not load docimg_cv.so, "
+                              << "its pages are detected in process" << std::endl;
+                } else if (i < wanted) {
+                    spawn(i);
                 }
-                threads.erase(
-                    std::remove_if(threads.begin(), threads.end(), 
-                        [](std::thread& t){ return !t.joinable(); }),
-                    threads.end());
             }
-            threads.emplace_back(process_single_image, image_path, folder_path, use_tesseract);
-            active_threads++;
-        } else {
-            // Serial
-            process_single_image(image_path, folder_path, use_tesseract);
         }
     }
 
-    // Join remaining threads (only in parallel mode)
-    if (g_use_multithreading) {
-        for (auto& t : threads) {
-            if (t.joinable()) t.join();
-        }
+    for (int i = 0; i < PREFORK_MAX_WORKERS; i++) {
+        if (pids[i] > 0) kill(pids[i], SIGTERM);
+    }
+    while (waitpid(-1, nullptr, 0) > 0) {}
+    _exit(0);
+}
+
+// Called at the top of main(), before any window or thread exists
+void prefork_init() {
+    size_t total = PREFORK_MAX_WORKERS * PREFORK_SLOT_STRIDE;
+    void* mem = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) return;
+    g_prefork_shm = (unsigned char*)mem;
+
+    for (int i = 0; i < PREFORK_MAX_WORKERS; i++) {
+        PageSlot* slot = prefork_slot(i);
+        pthread_mutexattr_t mattr;
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&slot->mutex, &mattr);
+        pthread_mutexattr_destroy(&mattr);
+
+        pthread_condattr_t cattr;
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&slot->cond, &cattr);
+        pthread_condattr_destroy(&cattr);
+
+        slot->state = SLOT_IDLE;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[1]);
+        prefork_supervisor_main(fds[0]);
+    }
+    close(fds[0]);
+    if (pid < 0) {
+        close(fds[1]);
+        return;
+    }
+    g_prefork_cmd_fd = fds[1];
+    g_prefork_supervisor = pid;
+    support_PREFORK = true;
+}
+
+void prefork_start(int workers) {
+    std::lock_guard<std::mutex> lock(g_prefork_mutex);
+    workers = std::min(workers, PREFORK_MAX_WORKERS);
+    PreforkCommand cmd = {PREFORK_START, workers};
+    if (send(g_prefork_cmd_fd, &cmd, sizeof(cmd), MSG_NOSIGNAL) == sizeof(cmd)) {
+        g_prefork_workers = std::max(g_prefork_workers, workers);
     }
 }
 
@@ -507,7 +1325,7 @@ void process_extracted_images_with_opencv(const std::string& folder_path, bool u
 int get_page_count(const std::string& filepath, const std::string& ftype) {
     if (ftype == "pdf") {
         std::string cmd = "pdfinfo \"" + filepath + "\" 2>/dev/null | grep Pages | awk '{print $2}'";
-        FILE* pipe = popen(cmd.c_str(), "r");
+        FILE* pipe = open_command(cmd.c_str(), "r");
         if (pipe) {
             char buffer[32];
             if (fgets(buffer, sizeof(buffer), pipe)) {
@@ -521,7 +1339,7 @@ int get_page_count(const std::string& filepath, const std::string& ftype) {
     }
     else if (ftype == "djvu") {
         std::string cmd = "djvused -e 'n' \"" + filepath + "\" 2>/dev/null";
-        FILE* pipe = popen(cmd.c_str(), "r");
+        FILE* pipe = open_command(cmd.c_str(), "r");
         if (pipe) {
             char buffer[32];
             if (fgets(buffer, sizeof(buffer), pipe)) {
@@ -537,33 +1355,202 @@ int get_page_count(const std::string& filepath, const std::string& ftype) {
 }
 
 // ==========================================
-// Rendering Functions (Parallelized)
+// Speculative Re-execution
 // ==========================================
+// Both copies of a straggling page task are shell commands in their own
+// process group, so the one that loses can be killed outright. The parent
+// sleeps in poll() on their output and pidfds, waking when one exits; the
+// timeout only paces the straggler check.
+
+const int SPECULATE_CHECK_MS = 250; // Straggler check interval while a backup may still be started
+const int SPECULATE_POLL_MS = 50;   // Exit check interval for children without a pidfd
+
+struct SpeculativeChild {
+    pid_t pid = 0;
+    int fd = -1;                     // stdout, while it is being collected
+    int pidfd = -1;                  // Readable once the child exits, until reaped
+    int status = -1;                 // Wait status once reaped
+    std::vector<unsigned char> out;
+};
 
-void render_single_pdf_page(const std::string& filepath, int page, const std::string& output_folder, const std::string& prefix) {
-    std::stringstream ss;
-    ss << std::setw(4) << std::setfill('0') << page;
-    
-    // > /dev/null 2>&1 suppresses the "Invalid resolution" warnings
-    std::string cmd = "pdftoppm -f " + std::to_string(page) + " -l " + std::to_string(page) + 
-                      " -png -r 200 \"" + filepath + "\" \"" + prefix + "\" > /dev/null 2>&1";
-    system(cmd.c_str());
-
-    g_processed_work_units++; // Atomic
+static bool start_speculative_child(const std::string& cmd, bool capture, SpeculativeChild& child) {
+    int fds[2] = {-1, -1};
+    if (capture && pipe2(fds, O_CLOEXEC) != 0) return false;
+    const char* line = cmd.c_str();
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        if (capture) dup2(fds[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", line, (char*)nullptr);
+        _exit(127);
+    }
+    if (capture) close(fds[1]);
+    if (pid < 0) {
+        if (capture) close(fds[0]);
+        return false;
+    }
+    setpgid(pid, pid); // From this side too, so the group exists before any kill
+    count_cost(g_subprocesses, &DocCosts::subprocesses);
+    child.pid = pid;
+    child.fd = fds[0];
+#ifdef SYS_pidfd_open
+    child.pidfd = (int)syscall(SYS_pidfd_open, pid, 0); // -1 before Linux 5.3: poll for the exit instead
+#endif
+    return true;
 }
 
-void render_pdf_pages(const std::string& filepath, const std::string& output_folder, const std::string& filename_display) {
+int run_speculative(StageTuner& stage, int page, const std::string& primary, const std::string& backup,
+                    std::vector<unsigned char>* out) {
+    if (!g_speculate) {
+        // No backup will ever be started: a plain shell-out
+        if (!out) return run_command(primary.c_str()) == -1 ? -1 : 0;
+        FILE* pipe = open_command(primary.c_str(), "r");
+        if (!pipe) return -1;
+        unsigned char buffer[1 << 16];
+        size_t got;
+        out->clear();
+        while ((got = fread(buffer, 1, sizeof(buffer), pipe)) > 0) out->insert(out->end(), buffer, buffer + got);
+        pclose(pipe);
+        return 0;
+    }
+
+    SpeculativeChild child[2];
+    if (!start_speculative_child(primary, out != nullptr, child[0])) return -1;
+    auto start = std::chrono::steady_clock::now();
+    bool speculating = false;
+    int winner = -1;
+
+    while (winner < 0) {
+        // Sleep until output arrives or a child exits. Without a pidfd the
+        // exit is only noticed on the next timeout.
+        struct pollfd pfd[4];
+        int who[4];
+        int n = 0;
+        int timeout = (!speculating && !backup.empty() && child[0].status < 0) ? SPECULATE_CHECK_MS : -1;
+        for (int i = 0; i < 2; i++) {
+            if (child[i].fd >= 0) {
+                pfd[n] = {child[i].fd, POLLIN, 0};
+                who[n++] = i;
+            }
+            if (child[i].pidfd >= 0) {
+                pfd[n] = {child[i].pidfd, POLLIN, 0};
+                who[n++] = -1;
+            } else if (child[i].pid > 0 && child[i].status < 0) {
+                timeout = (timeout < 0) ? SPECULATE_POLL_MS : std::min(timeout, SPECULATE_POLL_MS);
+            }
+        }
+        poll(pfd, n, timeout);
+        for (int k = 0; k < n; k++) {
+            if (!pfd[k].revents || who[k] < 0) continue;
+            SpeculativeChild& c = child[who[k]];
+            unsigned char buffer[1 << 16];
+            ssize_t got = read(c.fd, buffer, sizeof(buffer));
+            if (got > 0) {
+                c.out.insert(c.out.end(), buffer, buffer + got);
+            } else if (got == 0 || errno != EINTR) {
+                close(c.fd);
+                c.fd = -1;
+            }
+        }
+
+        // A copy that failed only stands if nothing else is still running
+        int live = 0, failed = -1;
+        for (int i = 0; i < 2 && winner < 0; i++) {
+            SpeculativeChild& c = child[i];
+            if (c.pid <= 0) continue;
+            if (c.status < 0) {
+                int status;
+                pid_t r = waitpid(c.pid, &status, WNOHANG);
+                if (r == c.pid) c.status = status;
+                else if (r < 0) c.status = 127 << 8;
+                if (c.status >= 0 && c.pidfd >= 0) {
+                    close(c.pidfd);
+                    c.pidfd = -1;
+                }
+            }
+            if (c.status < 0 || c.fd >= 0) live++;
+            else if (WIFEXITED(c.status) && WEXITSTATUS(c.status) == 0) winner = i;
+            else if (failed < 0) failed = i;
+        }
+        if (winner < 0 && live == 0) winner = failed;
+        if (winner >= 0) break;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!speculating && !backup.empty() && child[0].status < 0 && should_speculate(stage, elapsed)) {
+            if (start_speculative_child(backup, out != nullptr, child[1])) {
+                speculating = true;
+                stage.speculative++;
+                std::cout << "[speculate] " << t_doc->name << " page " << page << ": " << stage.name
+                          << " still running after " << std::fixed << std::setprecision(1) << elapsed
+                          << " s, starting a backup" << std::endl;
+            }
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        SpeculativeChild& c = child[i];
+        if (c.pid <= 0) continue;
+        if (c.status < 0) {
+            kill(-c.pid, SIGKILL);
+            kill(c.pid, SIGKILL);
+            waitpid(c.pid, nullptr, 0);
+        }
+        if (c.fd >= 0) close(c.fd);
+        if (c.pidfd >= 0) close(c.pidfd);
+    }
+    if (speculating) {
+        stage.speculative--;
+        std::cout << "[speculate] " << t_doc->name << " page " << page << ": "
+                  << (winner == 1 ? "backup" : "original") << " finished first" << std::endl;
+    }
+    if (out) *out = std::move(child[winner].out);
+    return winner;
+}
+
+// ==========================================
+// Rendering Functions (Parallelized)
+// ==========================================
+
+void render_single_pdf_page(const std::string& filepath, int page, int pages, const std::string& output_folder, const std::string& prefix) {
+    StageTask task(g_render_stage, output_folder, page);
+    std::string range = "-f " + std::to_string(page) + " -l " + std::to_string(page) +
+                        " -png -r " + std::to_string(PDF_RENDER_DPI) + " \"" + filepath + "\" ";
+
+    // > /dev/null 2>&1 suppresses the "Invalid resolution" warnings
+    std::string cmd = "pdftoppm " + range + "\"" + prefix + "\" > /dev/null 2>&1";
+
+    // A straggling page is rendered again by cairo, which copes differently
+    // with pathological vector content; same DPI, so figure boxes agree
+    std::string backup_root = output_folder + "/.speculative-" + std::to_string(page);
+    std::string backup;
+    if (support_PDF_VECTOR) backup = "pdftocairo -singlefile " + range + "\"" + backup_root + "\" > /dev/null 2>&1";
+
+    if (run_speculative(g_render_stage, page, cmd, backup) == 1) {
+        std::string page_png = output_folder + "/" + rendered_page_name("pdf", page, pages) + ".png";
+        rename((backup_root + ".png").c_str(), page_png.c_str());
+    } else if (!backup.empty()) {
+        unlink((backup_root + ".png").c_str());
+    }
+
+    g_processed_work_units++; // Atomic
+}
+
+// todo selects pages by number (see IncrementalRun); empty renders all
+void render_pdf_pages(const std::string& filepath, const std::string& output_folder, const std::string& filename_display,
+                      const std::vector<bool>& todo = std::vector<bool>()) {
     mkdir(output_folder.c_str(), 0777);
     std::string prefix = output_folder + "/page";
     
     int pages = get_page_count(filepath, "pdf");
+    g_render_stage.enqueue(todo.empty() ? pages : (int)std::count(todo.begin(), todo.end(), true));
     
     std::vector<std::thread> threads;
     int active_threads = 0;
 
     for (int page = 1; page <= pages; ++page) {
+        if (!todo.empty() && (page >= (int)todo.size() || !todo[page])) continue;
         if (g_use_multithreading) {
-            while (active_threads >= MAX_RENDER_THREADS) {
+            while (active_threads >= g_render_stage.limit) {
                 for (auto& t : threads) {
                     if (t.joinable()) {
                         t.join();
@@ -575,10 +1562,10 @@ void render_pdf_pages(const std::string& filepath, const std::string& output_fol
                         [](std::thread& t){ return !t.joinable(); }),
                     threads.end());
             }
-            threads.emplace_back(render_single_pdf_page, filepath, page, output_folder, prefix);
+            threads.push_back(spawn_task([=] { render_single_pdf_page(filepath, page, pages, output_folder, prefix); }));
             active_threads++;
         } else {
-            render_single_pdf_page(filepath, page, output_folder, prefix);
+            render_single_pdf_page(filepath, page, pages, output_folder, prefix);
         }
     }
 
@@ -590,6 +1577,7 @@ void render_pdf_pages(const std::string& filepath, const std::string& output_fol
 }
 
 void render_single_djvu_page(const std::string& filepath, int page, const std::string& output_folder) {
+    StageTask task(g_render_stage, output_folder, page);
     std::stringstream ss;
     ss << std::setw(4) << std::setfill('0') << page;
     std::string padded = ss.str();
@@ -597,22 +1585,25 @@ void render_single_djvu_page(const std::string& filepath, int page, const std::s
     // FIX: ddjvu does not support PNG output. Changed to TIFF.
     std::string output_tif = output_folder + "/page_" + padded + ".tif";
     std::string render_cmd = "ddjvu -format=tiff -page=" + std::to_string(page) + " \"" + filepath + "\" \"" + output_tif + "\" > /dev/null 2>&1";
-    system(render_cmd.c_str());
+    run_command(render_cmd.c_str());
     
     g_processed_work_units++;
 }
 
-void render_djvu_pages(const std::string& filepath, const std::string& output_folder, const std::string& filename_display) {
+void render_djvu_pages(const std::string& filepath, const std::string& output_folder, const std::string& filename_display,
+                       const std::vector<bool>& todo = std::vector<bool>()) {
     mkdir(output_folder.c_str(), 0777);
     int pages = get_page_count(filepath, "djvu");
     if (pages <= 0) return;
+    g_render_stage.enqueue(todo.empty() ? pages : (int)std::count(todo.begin(), todo.end(), true));
 
     std::vector<std::thread> threads;
     int active_threads = 0;
 
     for (int page = 1; page <= pages; ++page) {
+        if (!todo.empty() && (page >= (int)todo.size() || !todo[page])) continue;
         if (g_use_multithreading) {
-            while (active_threads >= MAX_RENDER_THREADS) {
+            while (active_threads >= g_render_stage.limit) {
                 for (auto& t : threads) {
                     if (t.joinable()) {
                         t.join();
@@ -624,7 +1615,7 @@ void render_djvu_pages(const std::string& filepath, const std::string& output_fo
                         [](std::thread& t){ return !t.joinable(); }),
                     threads.end());
             }
-            threads.emplace_back(render_single_djvu_page, filepath, page, output_folder);
+            threads.push_back(spawn_task([=] { render_single_djvu_page(filepath, page, output_folder); }));
             active_threads++;
         } else {
             render_single_djvu_page(filepath, page, output_folder);
@@ -638,14 +1629,13 @@ void render_djvu_pages(const std::string& filepath, const std::string& output_fo
     }
 }
 
-// ==========================================
 // Extraction Functions
 // ==========================================
 void extract_pdf_images(const std::string& filepath, const std::string& output_folder) {
     mkdir(output_folder.c_str(), 0777);
     std::string prefix = output_folder + "/img";
     std::string cmd = "pdfimages -all '" + filepath + "' '" + prefix + "' > /dev/null 2>&1";
-    system(cmd.c_str());
+    run_command(cmd.c_str());
     g_processed_work_units++; 
 }
 
@@ -657,13 +1647,14 @@ void extract_djvu_images(const std::string& filepath, const std::string& output_
     std::string temp_dir = output_folder + "/_djvu_temp";
     mkdir(temp_dir.c_str(), 0777);
     const int SIZE_THRESHOLD = 200;
+    g_render_stage.enqueue(pages);
 
     std::vector<std::thread> threads;
     int active_threads = 0;
 
     for (int page = 1; page <= pages; ++page) {
         if (g_use_multithreading) {
-            while (active_threads >= MAX_RENDER_THREADS) {
+            while (active_threads >= g_render_stage.limit) {
                 for (auto& t : threads) {
                     if (t.joinable()) {
                         t.join();
@@ -676,10 +1667,11 @@ void extract_djvu_images(const std::string& filepath, const std::string& output_
                     threads.end());
             }
 
-            threads.emplace_back([filepath, output_folder, temp_dir, page]() {
+            threads.push_back(spawn_task([filepath, output_folder, temp_dir, page]() {
+                StageTask task(g_render_stage, output_folder, page);
                 std::string iw44_file = temp_dir + "/page_" + std::to_string(page) + ".iw44";
                 std::string extract_cmd = "djvuextract '" + filepath + "' BG44='" + iw44_file + "' -page=" + std::to_string(page) + " > /dev/null 2>&1";
-                if (system(extract_cmd.c_str()) != 0) return;
+                if (run_command(extract_cmd.c_str()) != 0) return;
 
                 struct stat st;
                 if (stat(iw44_file.c_str(), &st) != 0 || st.st_size <= SIZE_THRESHOLD) {
@@ -693,20 +1685,21 @@ void extract_djvu_images(const std::string& filepath, const std::string& output_
                 std::string padded = std::string(4 - page_num.length(), '0') + page_num;
                 std::string output_tif = output_folder + "/page_" + padded + ".tif";
                 std::string render_cmd = "ddjvu -format=tiff -page=" + std::to_string(page) + " '" + filepath + "' '" + output_tif + "' > /dev/null 2>&1";
-                system(render_cmd.c_str());
+                run_command(render_cmd.c_str());
 
                 if (stat(output_tif.c_str(), &st) == 0 && st.st_size > 1000) {
                     // File valid, keep it. No counter needed.
                 }
                 unlink(iw44_file.c_str());
                 g_processed_work_units++;
-            });
+            }));
             active_threads++;
         } else {
             // Serial execution for djvu extraction
+            StageTask task(g_render_stage, output_folder, page);
             std::string iw44_file = temp_dir + "/page_" + std::to_string(page) + ".iw44";
             std::string extract_cmd = "djvuextract '" + filepath + "' BG44='" + iw44_file + "' -page=" + std::to_string(page) + " > /dev/null 2>&1";
-            if (system(extract_cmd.c_str()) == 0) {
+            if (run_command(extract_cmd.c_str()) == 0) {
                  struct stat st;
                 if (stat(iw44_file.c_str(), &st) == 0 && st.st_size > SIZE_THRESHOLD) {
                     // FIX: Use 'page' for filename
@@ -715,7 +1708,7 @@ void extract_djvu_images(const std::string& filepath, const std::string& output_
                     std::string padded = std::string(4 - page_num.length(), '0') + page_num;
                     std::string output_tif = output_folder + "/page_" + padded + ".tif";
                     std::string render_cmd = "ddjvu -format=tiff -page=" + std::to_string(page) + " '" + filepath + "' '" + output_tif + "' > /dev/null 2>&1";
-                    system(render_cmd.c_str());
+                    run_command(render_cmd.c_str());
                     if (stat(output_tif.c_str(), &st) == 0 && st.st_size > 1000) {
                         // File valid.
                     }
@@ -733,21 +1726,61 @@ void extract_djvu_images(const std::string& filepath, const std::string& output_
     }
 
     std::string rmdir_cmd = "rm -rf '" + temp_dir + "'";
-    system(rmdir_cmd.c_str());
+    run_command(rmdir_cmd.c_str());
 }
 
 void extract_zip_container(const std::string& filepath, const std::string& output_folder) {
     mkdir(output_folder.c_str(), 0777);
     std::string cmd = "unzip -j -o '" + filepath + "' '*.[pP][nN][gG]' '*.[jJ][pP][gG]' '*.[jJ][pP][eE][gG]' '*.[gG][iI][fF]' '*.[bB][mM][pP]' '*.[tT][iI][fF]*' '*.[sS][vV][gG]' '*.[wW][mM][fF]' '*.[eE][mM][fF]' -x '*/thumbnail*' -d '" + output_folder + "' > /dev/null 2>&1";
-    system(cmd.c_str());
+    run_command(cmd.c_str());
     g_processed_work_units++;
 }
 
+// Whether an office/EPUB container holds figures that only exist once the
+// document is laid out: vector shapes, charts, embedded objects, EMF/WMF/SVG.
+// Containers whose figures are all PNG/JPEG media (or that have none) skip
+// the soffice -> PDF -> render round trip; their media is extracted directly.
+bool container_needs_render(const std::string& filepath) {
+    std::string cmd = "unzip -Z1 '" + filepath + "' 2> /dev/null";
+    FILE* pipe = open_command(cmd.c_str(), "r");
+    if (!pipe) return true;
+
+    bool needs_render = false;
+    bool listed = false;
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), pipe)) {
+        listed = true;
+        std::string entry(buffer);
+        if (!entry.empty() && entry.back() == '\n') entry.pop_back();
+        std::transform(entry.begin(), entry.end(), entry.begin(), ::tolower);
+        size_t dot = entry.find_last_of('.');
+        std::string ext = (dot == std::string::npos) ? "" : entry.substr(dot);
+
+        if (ext == ".emf" || ext == ".wmf" || ext == ".svg" || ext == ".svgz" ||
+            entry.find("/charts/") != std::string::npos ||      // OOXML charts
+            entry.find("/embeddings/") != std::string::npos ||  // OLE objects
+            entry.compare(0, 7, "object ") == 0 ||              // ODF charts/objects
+            entry.compare(0, 4, "ppt/") == 0) {                 // Slides are shapes
+            needs_render = true;
+        }
+    }
+    pclose(pipe);
+    if (!listed) return true; // Not readable as a zip; keep the full path
+    if (needs_render) return true;
+
+    // Drawing markup in the body text (DOCX, ODF, EPUB)
+    cmd = "unzip -p '" + filepath + "' 'word/document.xml' 'content.xml' '*.xhtml' '*.html' '*.htm' 2> /dev/null"
+          " | grep -qE '<(wps:wsp|wpg:wgp|wpc:wpc|c:chart|v:rect|v:roundrect|v:line|v:oval|v:polyline|v:group|"
+          "draw:custom-shape|draw:line|draw:path|draw:polygon|draw:polyline|draw:rect|draw:circle|draw:ellipse|"
+          "draw:connector|draw:object|svg)[ >/]'";
+    return run_command(cmd.c_str()) == 0;
+}
+
 void convert_and_extract_legacy_doc(const std::string& filepath, const std::string& output_folder) {
     std::string temp_dir = output_folder + "/_temp_doc";
     mkdir(temp_dir.c_str(), 0777);
     std::string cmd = "soffice --headless --convert-to docx --outdir '" + temp_dir + "' '" + filepath + "' > /dev/null 2>&1";
-    system(cmd.c_str());
+    run_command(cmd.c_str());
     
     std::string docx_found;
     DIR* dir = opendir(temp_dir.c_str());
@@ -765,13 +1798,13 @@ void convert_and_extract_legacy_doc(const std::string& filepath, const std::stri
     if (!docx_found.empty()) extract_zip_container(docx_found, output_folder);
     
     std::string rm_cmd = "rm -rf '" + temp_dir + "'";
-    system(rm_cmd.c_str());
+    run_command(rm_cmd.c_str());
 }
 
 std::string detect_file_type(const std::string& filepath) {
     std::string mime;
     std::string cmd = "file --brief --mime-type '" + filepath + "'";
-    FILE* pipe = popen(cmd.c_str(), "r");
+    FILE* pipe = open_command(cmd.c_str(), "r");
     if (pipe) {
         char buffer[128];
         if (fgets(buffer, sizeof(buffer), pipe)) {
@@ -796,37 +1829,224 @@ std::string detect_file_type(const std::string& filepath) {
 }
 
 // ==========================================
+// Workload Pre-Scan (Background)
+// ==========================================
+// Type detection and page counting spawn a subprocess per file, so they run
+// in parallel alongside processing. Every input starts with a provisional
+// estimate; g_total_work_units is corrected as real estimates arrive.
+
+struct InputScan {
+    std::string ftype;
+    int pages = 1;
+    Lane lane = Lane::Bulk;
+    std::atomic<bool> ready{false};
+    std::atomic<bool> claimed{false}; // Taken by one of the lanes
+    size_t prefetched = 0;            // Bytes charged to the prefetch budget (g_prefetch_mutex)
+    std::string folder_name;          // Output folder, unique within the run
+};
+
+std::vector<std::unique_ptr<InputScan>> g_input_scans;
+
+// Documents the pre-scan found small, in the order it sized them; the
+// interactive lane waits here instead of polling the input list, and the
+// bulk lane waits on g_scan_cv for the scan of its next document
+std::mutex g_scan_mutex;
+std::condition_variable g_scan_cv;
+std::deque<size_t> g_interactive_queue; // Indexes into g_input_scans (g_scan_mutex)
+bool g_scan_done = false;               // (g_scan_mutex)
+
+int estimate_work_units(const std::string& ftype, int pages, bool use_opencv) {
+    if (use_opencv) {
+        if ((ftype == "pdf" && support_PDF_RENDER) || 
+            (ftype == "djvu" && support_DJVU) ||
+            ((support_DOC || support_EPUB) && support_PDF_RENDER)) {
+            return pages * 2; // Render + Process
+        }
+        return 6; // Avg extraction + processing
+    }
+    if (ftype == "djvu") return pages;
+    return 1;
+}
+
+void prescan_inputs(bool use_opencv) {
+    std::atomic<size_t> next{0};
+    int provisional = estimate_work_units("unknown", 1, use_opencv);
+
+    auto scan_worker = [&]() {
+        size_t i;
+        while ((i = next++) < g_input_scans.size()) {
+            InputScan& scan = *g_input_scans[i];
+            const std::string& path = input_files_vec[i];
+            std::string ftype = detect_file_type(path);
+            int pages = 1;
+            if (ftype == "pdf" || ftype == "djvu") {
+                pages = get_page_count(path, ftype);
+            }
+            scan.ftype = ftype;
+            scan.pages = pages;
+            scan.lane = classify_lane(path, pages);
+            g_docs[i]->pages = pages;
+            g_total_work_units += estimate_work_units(ftype, pages, use_opencv) - provisional;
+            {
+                std::lock_guard<std::mutex> lock(g_scan_mutex);
+                scan.ready = true;
+                if (scan.lane == Lane::Interactive) g_interactive_queue.push_back(i);
+            }
+            g_scan_cv.notify_all();
+        }
+    };
+
+    int workers = g_use_multithreading ? MAX_RENDER_THREADS : 1;
+    workers = std::min(workers, (int)g_input_scans.size());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < workers; t++) threads.emplace_back(scan_worker);
+    for (auto& t : threads) t.join();
+
+    {
+        std::lock_guard<std::mutex> lock(g_scan_mutex);
+        g_scan_done = true;
+    }
+    g_scan_cv.notify_all();
+}
+
+// ==========================================
+// Input Prefetch
+// ==========================================
+// On cold (HDD) storage each document's first render stalls on reads while
+// the CPU idles between documents. A prefetch thread asks the kernel to pull
+// the next unclaimed inputs into the page cache (posix_fadvise WILLNEED
+// starts asynchronous readahead) while earlier ones are processed. Bytes
+// read ahead count against a budget until their document finishes, so
+// prefetching never runs far enough ahead to evict what the running
+// documents are using. DOCIMG_PREFETCH_MB sets the budget; 0 turns it off.
+const size_t PREFETCH_DEFAULT_MB = 256;
+const int PREFETCH_MAX_DOCS = 4; // Documents read ahead at once
+
+std::mutex g_prefetch_mutex;
+std::condition_variable g_prefetch_cv;
+size_t g_prefetch_bytes = 0;
+int g_prefetch_docs = 0;
+bool g_prefetch_stop = false;
+
+size_t prefetch_budget() {
+    const char* env = getenv("DOCIMG_PREFETCH_MB");
+    size_t mb = (env && *env) ? (size_t)atol(env) : PREFETCH_DEFAULT_MB;
+    return mb << 20;
+}
+
+void prefetch_inputs() {
+    size_t budget = prefetch_budget();
+    if (budget == 0) return;
+
+    for (size_t i = 0; i < g_input_scans.size(); i++) {
+        InputScan& scan = *g_input_scans[i];
+        struct stat st;
+        if (scan.claimed || stat(input_files_vec[i].c_str(), &st) != 0 || st.st_size == 0) continue;
+
+        size_t bytes;
+        {
+            std::unique_lock<std::mutex> lock(g_prefetch_mutex);
+            g_prefetch_cv.wait(lock, [&] {
+                return g_prefetch_stop || (g_prefetch_docs < PREFETCH_MAX_DOCS && g_prefetch_bytes < budget);
+            });
+            if (g_prefetch_stop) return;
+            if (scan.claimed) continue; // Its lane got there first and is reading it already
+            // A document larger than what is left gets its head read ahead
+            bytes = std::min((size_t)st.st_size, budget - g_prefetch_bytes);
+            scan.prefetched = bytes;
+            g_prefetch_bytes += bytes;
+            g_prefetch_docs++;
+        }
+
+        int fd = open(input_files_vec[i].c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        posix_fadvise(fd, 0, bytes, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+// Give back a document's share of the prefetch budget once it is processed
+void prefetch_release(InputScan& scan) {
+    {
+        std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+        if (scan.prefetched == 0) return;
+        g_prefetch_bytes -= scan.prefetched;
+        g_prefetch_docs--;
+        scan.prefetched = 0;
+    }
+    g_prefetch_cv.notify_all();
+}
+
 // Processing Logic
 // ==========================================
 
-void process_document(const std::string& filepath, const std::string& output_root, bool use_opencv, bool use_tesseract) {
+// Output folder of an input: its file name without the extension
+std::string output_folder_name(const std::string& filepath) {
+    std::string name = filepath.substr(filepath.find_last_of("/\\") + 1);
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos) name.erase(dot);
+    return name;
+}
+
+// name, or name_2, name_3... when taken already has it; the result is added
+// to taken. Inputs that run at the same time must not share a folder.
+std::string unique_folder_name(const std::string& name, std::set<std::string>& taken) {
+    std::string unique = name;
+    for (int n = 2; !taken.insert(unique).second; n++) unique = name + "_" + std::to_string(n);
+    if (unique != name) std::cerr << "[lanes] another input is already writing to " << name << ", using " << unique << std::endl;
+    return unique;
+}
+
+// folder_name overrides the output folder name (see unique_folder_name)
+void process_document(const std::string& filepath, const std::string& output_root, bool use_opencv, bool use_tesseract,
+                      std::string ftype = "", const std::string& folder_name = "") {
     struct stat st;
     if (stat(filepath.c_str(), &st) != 0) return;
     
-    std::string ftype = detect_file_type(filepath);
-    std::string basename = filepath.substr(filepath.find_last_of("/\\") + 1);
-    size_t dot = basename.rfind('.');
-    if (dot != std::string::npos) basename.erase(dot);
+    if (ftype.empty()) ftype = detect_file_type(filepath);
+    std::string basename = folder_name.empty() ? output_folder_name(filepath) : folder_name;
     std::string target_folder = output_root + "/" + basename;
     mkdir(target_folder.c_str(), 0777);
 
     bool pages_rendered = false;
+    bool pages_detected = false;
+    DocumentSource source;
+    if (g_skip_seen_figures) {
+        source.seen_root = output_root;
+        source.seen_document = basename;
+    }
+    IncrementalRun incremental;
+    std::string placed_dir = target_folder + "/_placed_images";
 
     if (use_opencv) {
         if (ftype == "pdf" && support_PDF_RENDER) {
-            render_pdf_pages(filepath, target_folder, basename);
+            if (support_PDF_PLACEMENT) source.placements = collect_placed_images(filepath, placed_dir);
+            QdfDocument qdf;
+            if (support_QPDF && load_qdf(filepath, placed_dir, qdf)) {
+                collect_form_xobjects(qdf, source.placements);
+                incremental.plan(target_folder, ftype, pdf_page_fingerprints(qdf), get_page_count(filepath, ftype));
+            }
+            if (g_vector_figures && support_PDF_VECTOR) source.vector_pdf = filepath;
+            if (g_use_page_store && g_cv) {
+                g_cv->render_and_detect_pdf(filepath, target_folder, use_tesseract && support_TESSERACT, source, incremental.todo);
+                pages_detected = true;
+            } else {
+                render_pdf_pages(filepath, target_folder, basename, incremental.todo);
+            }
             pages_rendered = true;
         }
         else if (ftype == "djvu" && support_DJVU) {
-            render_djvu_pages(filepath, target_folder, basename);
+            incremental.plan(target_folder, ftype, djvu_page_fingerprints(filepath, placed_dir), get_page_count(filepath, ftype));
+            render_djvu_pages(filepath, target_folder, basename, incremental.todo);
             pages_rendered = true;
         }
-        else if ((support_DOC || support_EPUB) && support_PDF_RENDER) {
+        else if ((support_DOC || support_EPUB) && support_PDF_RENDER &&
+                 (ftype != "zip_container" || container_needs_render(filepath))) {
             std::string temp_dir = target_folder + "/_temp_pdf_convert";
             mkdir(temp_dir.c_str(), 0777);
 
             std::string convert_cmd = "soffice --headless --convert-to pdf --outdir '" + temp_dir + "' '" + filepath + "' > /dev/null 2>&1";
-            system(convert_cmd.c_str());
+            run_command(convert_cmd.c_str());
 
             std::string converted_pdf;
             DIR* dir = opendir(temp_dir.c_str());
@@ -845,11 +2065,14 @@ void process_document(const std::string& filepath, const std::string& output_roo
             if (!converted_pdf.empty() && stat(converted_pdf.c_str(), &st) == 0 && st.st_size > 1000) {
                 render_pdf_pages(converted_pdf, target_folder, basename);
                 pages_rendered = true;
+                if (support_PDF_PLACEMENT) source.placements = collect_placed_images(converted_pdf, placed_dir);
+                QdfDocument qdf;
+                if (support_QPDF && load_qdf(converted_pdf, placed_dir, qdf)) collect_form_xobjects(qdf, source.placements);
                 unlink(converted_pdf.c_str());
             }
 
             std::string rm_temp = "rm -rf '" + temp_dir + "'";
-            system(rm_temp.c_str());
+            run_command(rm_temp.c_str());
         }
     }
 
@@ -868,8 +2091,24 @@ void process_document(const std::string& filepath, const std::string& output_roo
         }
     }
 
-    if (use_opencv && support_OPENCV) {
-        process_extracted_images_with_opencv(target_folder, use_tesseract && support_TESSERACT);
+    if (use_opencv && g_cv && !pages_detected) {
+        // This document's detections only; the other lane detects at the same time
+        long detected_before = t_doc->detected;
+        g_cv->process_folder(target_folder, use_tesseract && support_TESSERACT, source);
+        if (!pages_rendered) count_cost(g_images, &DocCosts::images, t_doc->detected - detected_before); // Extracted images, not pages
+    }
+    incremental.finish();
+
+    if (stat(placed_dir.c_str(), &st) == 0) {
+        std::string rm_placed = "rm -rf '" + placed_dir + "'";
+        run_command(rm_placed.c_str());
+    }
+
+    if (g_skip_seen_figures && g_cv && !pages_rendered) {
+        // Detected figures were checked as they were written; what is left
+        // are the images the extraction tools wrote (rendered pages are
+        // working files, not figures)
+        g_cv->skip_seen_figures(output_root, basename, {basename});
     }
 }
 
@@ -924,17 +2163,255 @@ static void opencv_toggle_cb(Fl_Widget* o, void* data) {
             tesseract_toggle->value(0);
         }
     }
+    if (deferocr_toggle && !tesseract_toggle->value()) {
+        deferocr_toggle->deactivate();
+        deferocr_toggle->value(0);
+    }
+    if (vector_toggle) {
+        if (opencv_toggle->value() && support_PDF_VECTOR) {
+            vector_toggle->activate();
+        } else {
+            vector_toggle->deactivate();
+            vector_toggle->value(0);
+        }
+    }
+    if (xycut_toggle) {
+        if (opencv_toggle->value()) {
+            xycut_toggle->activate();
+        } else {
+            xycut_toggle->deactivate();
+            xycut_toggle->value(0);
+        }
+    }
+    if (sauvola_toggle) {
+        if (opencv_toggle->value()) {
+            sauvola_toggle->activate();
+        } else {
+            sauvola_toggle->deactivate();
+            sauvola_toggle->value(0);
+        }
+    }
+    if (prefork_toggle) {
+        if (opencv_toggle->value() && support_PREFORK) {
+            prefork_toggle->activate();
+        } else {
+            prefork_toggle->deactivate();
+            prefork_toggle->value(0);
+        }
+    }
+    if (pagestore_toggle) {
+        if (opencv_toggle->value()) {
+            pagestore_toggle->activate();
+        } else {
+            pagestore_toggle->deactivate();
+            pagestore_toggle->value(0);
+        }
+    }
+}
+
+static void tesseract_toggle_cb(Fl_Widget* o, void* data) {
+    if (deferocr_toggle) {
+        if (tesseract_toggle->value()) {
+            deferocr_toggle->activate();
+        } else {
+            deferocr_toggle->deactivate();
+            deferocr_toggle->value(0);
+        }
+    }
+}
+
+static void multithread_toggle_cb(Fl_Widget* o, void* data) {
+    if (autotune_toggle) {
+        if (multithread_toggle->value()) {
+            autotune_toggle->activate();
+            speculate_toggle->activate();
+        } else {
+            autotune_toggle->deactivate();
+            autotune_toggle->value(0);
+            speculate_toggle->deactivate();
+            speculate_toggle->value(0);
+        }
+    }
+}
+
+static void lock_controls() {
+    b_input_files->deactivate();
+    b_output_dir->deactivate();
+    startb->deactivate();
+    watchb->deactivate();
+    opencv_toggle->deactivate();
+    multithread_toggle->deactivate();
+    autotune_toggle->deactivate();
+    tesseract_toggle->deactivate();
+    deferocr_toggle->deactivate();
+    vector_toggle->deactivate();
+    xycut_toggle->deactivate();
+    sauvola_toggle->deactivate();
+    prefork_toggle->deactivate();
+    pagestore_toggle->deactivate();
+    seen_toggle->deactivate();
+    speculate_toggle->deactivate();
+}
+
+static void unlock_controls() {
+    b_input_files->activate();
+    b_output_dir->activate();
+    startb->activate();
+    watchb->activate();
+    opencv_toggle->activate();
+    multithread_toggle->activate();
+    if(multithread_toggle->value()) autotune_toggle->activate();
+    if(multithread_toggle->value()) speculate_toggle->activate();
+    if(opencv_toggle->value() && support_TESSERACT) tesseract_toggle->activate();
+    if(tesseract_toggle->value()) deferocr_toggle->activate();
+    if(opencv_toggle->value() && support_PDF_VECTOR) vector_toggle->activate();
+    if(opencv_toggle->value()) xycut_toggle->activate();
+    if(opencv_toggle->value()) sauvola_toggle->activate();
+    if(opencv_toggle->value() && support_PREFORK) prefork_toggle->activate();
+    if(opencv_toggle->value()) pagestore_toggle->activate();
+    if(support_OPENCV) seen_toggle->activate();
+}
+
+// Set global flags from UI (main thread only)
+static void read_options() {
+    g_use_multithreading = multithread_toggle->value();
+    g_use_opencv = opencv_toggle->value();
+    g_use_tesseract = tesseract_toggle->value();
+    g_defer_ocr = g_use_tesseract && deferocr_toggle->value();
+    g_vector_figures = vector_toggle->value();
+    g_layout_engine = xycut_toggle->value() ? LayoutEngine::XYCut : LayoutEngine::Contours;
+    g_binarizer = sauvola_toggle->value() ? Binarizer::Sauvola : Binarizer::Gaussian;
+    g_use_prefork = support_PREFORK && prefork_toggle->value();
+    g_use_page_store = pagestore_toggle->value();
+    g_skip_seen_figures = seen_toggle->value();
+    if (g_use_prefork) prefork_start(g_use_multithreading ? MAX_CV_THREADS : 1);
+    g_use_autotune = g_use_multithreading && autotune_toggle->value();
+    g_speculate = g_use_multithreading && speculate_toggle->value();
+    g_render_stage.reset(MAX_RENDER_THREADS);
+    g_cv_stage.reset(MAX_CV_THREADS);
+}
+
+static bool check_output_dir() {
+    if (output_dir_str.empty()) {
+        status_box->label("Output folder is not chosen!");
+        status_box->labelcolor(FL_RED);
+        status_box->redraw();
+        Fl::add_timeout(4.0, clear_status_cb);
+        return false;
+    }
+    return true;
+}
+
+// Load the detection module if this run needs it (main thread only)
+static bool check_cv_engine() {
+    if (!(opencv_toggle->value() || seen_toggle->value()) || load_cv_engine()) return true;
+    status_box->label("Could not load the detection module (docimg_cv.so)!");
+    status_box->labelcolor(FL_RED);
+    status_box->redraw();
+    Fl::add_timeout(4.0, clear_status_cb);
+    return false;
+}
+
+// CPU seconds (self and reaped children) and resident bytes of this process
+static bool read_process_usage(double& cpu_seconds, long long& rss_bytes) {
+    std::ifstream stat("/proc/self/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return false;
+    // Fields after the parenthesised command name; utime is field 14
+    std::istringstream fields(line.substr(line.find_last_of(')') + 2));
+    std::string field;
+    unsigned long long ticks = 0;
+    for (int i = 3; i <= 17 && fields >> field; i++) {
+        if (i >= 14) ticks += std::stoull(field);
+    }
+    cpu_seconds = (double)ticks / sysconf(_SC_CLK_TCK);
+
+    std::ifstream statm("/proc/self/statm");
+    long long size = 0, resident = 0;
+    statm >> size >> resident;
+    rss_bytes = resident * sysconf(_SC_PAGESIZE);
+    return true;
+}
+
+// Redraw the dashboard text from the live counters (Main Thread, twice a second)
+void update_dashboard() {
+    static auto last = std::chrono::steady_clock::now();
+    static int last_pages = 0;
+    static double last_cpu = 0;
+    static double pages_per_s = 0;
+    static double cpu_pct = 0;
+
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - last).count();
+    if (dt < 0.5) return;
+    last = now;
+
+    // Pages leave the pipeline through detection, or through rendering alone
+    int pages = (int)(g_use_opencv ? g_cv_stage.completed.load() : g_render_stage.completed.load());
+    if (pages < last_pages) last_pages = 0; // Counters were reset for a new run
+    pages_per_s = 0.7 * pages_per_s + 0.3 * ((pages - last_pages) / dt);
+    last_pages = pages;
+
+    double cpu = 0;
+    long long rss = 0;
+    if (read_process_usage(cpu, rss)) {
+        if (cpu >= last_cpu) cpu_pct = (cpu - last_cpu) / dt * 100.0;
+        last_cpu = cpu;
+    }
+
+    double detect_s = g_detect_ns.load() / 1e9;
+    double ocr_s = g_ocr_ns.load() / 1e9;
+    double ocr_share = (detect_s + ocr_s) > 0 ? ocr_s / (detect_s + ocr_s) * 100.0 : 0;
+
+    char buf[160];
+    std::string text;
+    snprintf(buf, sizeof(buf), "%.1f pages/s   CPU %.0f%%   RSS %lld MB\n", pages_per_s, cpu_pct, rss >> 20);
+    text += buf;
+    for (const StageTuner* st : {&g_render_stage, &g_cv_stage}) {
+        snprintf(buf, sizeof(buf), "%-7s queued %3d   active %2d/%-2d   done %ld\n", st->name,
+                 std::max(0, st->queued.load()), st->active.load(), st->limit.load(), st->completed.load());
+        text += buf;
+    }
+    snprintf(buf, sizeof(buf), "detect %.1fs   OCR %.1fs (%.0f%% of CV time)\n", detect_s, ocr_s, ocr_share);
+    text += buf;
+
+    // Running and most recent documents first, as many as fit
+    std::vector<std::shared_ptr<DocProgress>> rows;
+    {
+        std::lock_guard<std::mutex> lock(g_docs_mutex);
+        for (auto it = g_docs.rbegin(); it != g_docs.rend(); ++it) {
+            if ((*it)->state == 1) rows.insert(rows.begin(), *it);
+            else if ((*it)->state == 2 && (int)rows.size() < DASHBOARD_DOC_ROWS) rows.push_back(*it);
+        }
+        for (const auto& d : g_docs) {
+            if ((int)rows.size() >= DASHBOARD_DOC_ROWS) break;
+            if (d->state == 0) rows.push_back(d);
+        }
+    }
+    static const char* STATE_NAMES[] = {"queued", "running", "done"};
+    for (int i = 0; i < std::min(DASHBOARD_DOC_ROWS, (int)rows.size()); i++) {
+        const DocProgress& d = *rows[i];
+        std::string name = d.name.size() > 22 ? d.name.substr(0, 19) + "..." : d.name;
+        if (d.lane == Lane::Interactive) name = "* " + name; // Interactive lane
+        std::string total = d.pages > 0 ? std::to_string(d.pages.load()) : "?";
+        snprintf(buf, sizeof(buf), "%-24s %-7s rendered %3d/%-3s detected %3d\n", name.c_str(),
+                 STATE_NAMES[d.state.load()], d.rendered.load(), total.c_str(), d.detected.load());
+        text += buf;
+    }
+
+    dashboard->buffer()->text(text.c_str());
 }
 
 // Timer to update UI from Main Thread while workers run in background
 void update_ui_cb(void*) {
-    float pct = (float)g_processed_work_units / g_total_work_units * 100.0f;
+    update_dashboard();
+    float pct = (float)g_processed_work_units / std::max(1, g_total_work_units.load()) * 100.0f;
     if (pct > 100.0f) pct = 100.0f;
     progress_bar->value(pct);
     
     progress_bar->redraw();
 
-    if (g_processed_work_units >= g_total_work_units) {
+    if (g_processing_done) {
         // Work is done
         progress_bar->hide();
         if (status_box) {
@@ -944,36 +2421,202 @@ void update_ui_cb(void*) {
             Fl::add_timeout(4.0, clear_status_cb);
         }
         
-        b_input_files->activate();
-        b_output_dir->activate();
-        startb->activate();
-        opencv_toggle->activate();
-        multithread_toggle->activate();
-        if(opencv_toggle->value() && support_TESSERACT) tesseract_toggle->activate();
+        unlock_controls();
     } else {
         Fl::repeat_timeout(0.05, update_ui_cb);
     }
 }
 
+// ==========================================
+// Cost Ledger (for tools/cost_model)
+// ==========================================
+// One JSON line per document in <output>/COST_LEDGER_FILE: what the document
+// looked like (type, bytes, pages, pixels, images, candidates, OCR calls) and
+// what it cost (wall, CPU of this process and its subprocesses, peak RSS,
+// per-stage time, subprocess count). Counters are process-wide, so entries
+// of documents that overlapped in the two lanes are marked "shared".
+
+const char* COST_LEDGER_FILE = "cost_ledger.jsonl";
+std::mutex g_ledger_mutex;
+
+struct CostSnapshot {
+    std::chrono::steady_clock::time_point wall;
+    double cpu = 0, child_cpu = 0;
+
+    static double seconds(const struct timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+    void take() {
+        wall = std::chrono::steady_clock::now();
+        struct rusage self, children;
+        getrusage(RUSAGE_SELF, &self);
+        getrusage(RUSAGE_CHILDREN, &children);
+        cpu = seconds(self.ru_utime) + seconds(self.ru_stime);
+        child_cpu = seconds(children.ru_utime) + seconds(children.ru_stime);
+    }
+};
+
+// Peak RSS is per process; clearing the high-water mark makes it per document
+static void reset_peak_rss() {
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+}
+
+static long long peak_rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return atoll(line.c_str() + 6);
+    }
+    return 0;
+}
+
+void write_cost_entry(const std::string& path, const std::string& ftype, int pages, const DocProgress& doc, bool shared,
+                      const CostSnapshot& before) {
+    CostSnapshot after;
+    after.take();
+    const DocCosts& c = doc.costs;
+    struct stat st;
+    long long bytes = (stat(path.c_str(), &st) == 0) ? (long long)st.st_size : 0;
+
+    std::lock_guard<std::mutex> lock(g_ledger_mutex);
+    FILE* ledger = fopen((output_dir_str + "/" + COST_LEDGER_FILE).c_str(), "a");
+    if (!ledger) return;
+    fprintf(ledger,
+            "{\"doc\":\"%s\",\"type\":\"%s\",\"bytes\":%lld,\"pages\":%d,\"pixel_area\":%lld,\"images\":%lld,"
+            "\"candidates\":%lld,\"ocr_calls\":%lld,\"opencv\":%s,\"ocr\":%s,\"render_threads\":%d,\"detect_threads\":%d,"
+            "\"lane\":\"%s\",\"shared\":%s,"
+            "\"wall\":%.3f,\"cpu\":%.3f,\"child_cpu\":%.3f,\"peak_rss_mb\":%.1f,"
+            "\"render\":%.3f,\"detect\":%.3f,\"ocr_time\":%.3f,\"subprocesses\":%lld}\n",
+            json_escape(path).c_str(), ftype.c_str(), bytes, pages, c.pixel_area.load(),
+            c.images.load(), c.candidates.load(), c.ocr_calls.load(),
+            g_use_opencv ? "true" : "false", g_use_tesseract ? "true" : "false",
+            c.render_limit.load(), c.detect_limit.load(),
+            doc.lane == Lane::Interactive ? "interactive" : "bulk", shared ? "true" : "false",
+            std::chrono::duration<double>(after.wall - before.wall).count(),
+            after.cpu - before.cpu, after.child_cpu - before.child_cpu, peak_rss_kb() / 1024.0,
+            c.render_ns / 1e9, c.detect_ns / 1e9, c.ocr_ns / 1e9, c.subprocesses.load());
+    fclose(ledger);
+}
+
+// Process one input with the current options (any thread)
+void process_input_file(const std::string& path, const std::string& ftype, DocProgress* doc, const std::string& folder_name) {
+    bool supported = false;
+    if (ftype == "pdf" && support_PDF) supported = true;
+    else if (ftype == "djvu" && support_DJVU) supported = true;
+    else if ((ftype == "docx" || ftype == "doc_legacy") && support_DOC) supported = true;
+    else if ((ftype == "zip_container" || ftype == "epub") && support_EPUB) supported = true;
+    
+    doc->state = 1;
+    t_doc = doc;
+    bool interactive = (doc->lane == Lane::Interactive);
+    if (interactive) g_interactive_docs++;
+    int running_before = g_running_docs++;
+    long long starts_before = g_doc_starts++;
+
+    if (supported) {
+        CostSnapshot before;
+        if (running_before == 0) reset_peak_rss();
+        before.take();
+        process_document(path, output_dir_str, g_use_opencv, g_use_tesseract, ftype, folder_name);
+        int pages = doc->pages;
+        if (pages <= 0) pages = (ftype == "pdf" || ftype == "djvu") ? get_page_count(path, ftype) : 1;
+        bool shared = running_before > 0 || g_doc_starts != starts_before + 1;
+        write_cost_entry(path, ftype, pages, *doc, shared, before);
+    } else {
+        g_processed_work_units++;
+    }
+
+    g_running_docs--;
+    if (interactive) {
+        g_interactive_docs--;
+        g_render_stage.reopen_gate();
+        g_cv_stage.reopen_gate();
+    }
+    t_doc = nullptr;
+    doc->state = 2;
+}
+
 // Thread function to handle the heavy lifting
 void process_files_thread() {
-    for (size_t i = 0; i < input_files_vec.size(); i++) {
-        g_current_file_index = (int)i;
-        const std::string& path = input_files_vec[i];
-        std::string ftype = detect_file_type(path);
-        
-        bool supported = false;
-        if (ftype == "pdf" && support_PDF) supported = true;
-        else if (ftype == "djvu" && support_DJVU) supported = true;
-        else if ((ftype == "docx" || ftype == "doc_legacy") && support_DOC) supported = true;
-        else if ((ftype == "zip_container" || ftype == "epub") && support_EPUB) supported = true;
-        
-        if (supported) {
-            process_document(path, output_dir_str, opencv_toggle->value(), tesseract_toggle->value());
-        } else {
-            g_processed_work_units++;
+    trace_open();
+    {
+        std::lock_guard<std::mutex> lock(g_scan_mutex);
+        g_interactive_queue.clear();
+        g_scan_done = false;
+    }
+    std::thread scanner(prescan_inputs, g_use_opencv);
+
+    {
+        std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+        g_prefetch_bytes = 0;
+        g_prefetch_docs = 0;
+        g_prefetch_stop = false;
+    }
+    std::thread prefetcher(prefetch_inputs);
+
+    std::thread tuner;
+    if (g_use_autotune) {
+        g_autotune_stop = false;
+        tuner = std::thread(autotune_thread_fn);
+    }
+
+    // Bulk lane: every document in order that the pre-scan did not find
+    // small. It waits for the scan of the document it takes next, so a small
+    // document is never claimed as bulk work just because it was not sized yet.
+    auto bulk_lane = [] {
+        for (size_t i = 0; i < input_files_vec.size(); i++) {
+            InputScan& scan = *g_input_scans[i];
+            {
+                std::unique_lock<std::mutex> lock(g_scan_mutex);
+                g_scan_cv.wait(lock, [&scan] { return scan.ready.load(); });
+            }
+            if (scan.lane == Lane::Interactive) continue;
+            if (scan.claimed.exchange(true)) continue;
+            g_current_file_index = (int)i;
+            const std::string& path = input_files_vec[i];
+            process_input_file(path, scan.ftype, g_docs[i].get(), scan.folder_name);
+            prefetch_release(scan);
         }
+    };
+
+    // Interactive lane: small documents as soon as the pre-scan has sized them
+    auto interactive_lane = [] {
+        while (true) {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(g_scan_mutex);
+                g_scan_cv.wait(lock, [] { return g_scan_done || !g_interactive_queue.empty(); });
+                if (g_interactive_queue.empty()) return;
+                i = g_interactive_queue.front();
+                g_interactive_queue.pop_front();
+            }
+            InputScan& scan = *g_input_scans[i];
+            if (scan.claimed.exchange(true)) continue;
+            g_docs[i]->lane = Lane::Interactive;
+            process_input_file(input_files_vec[i], scan.ftype, g_docs[i].get(), scan.folder_name);
+            prefetch_release(scan);
+        }
+    };
+
+    std::thread interactive(interactive_lane);
+    bulk_lane();
+    interactive.join();
+
+    if (tuner.joinable()) {
+        g_autotune_stop = true;
+        tuner.join();
     }
+
+    {
+        std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+        g_prefetch_stop = true;
+    }
+    g_prefetch_cv.notify_all();
+    prefetcher.join();
+
+    scanner.join();
+    trace_close();
+    g_processing_done = true;
 }
 
 static void start_cb (Fl_Widget* o) {
@@ -984,68 +2627,33 @@ static void start_cb (Fl_Widget* o) {
         Fl::add_timeout(4.0, clear_status_cb);
         return;
     }
-    if (output_dir_str.empty()) {
-        status_box->label("Output folder is not chosen!");
-        status_box->labelcolor(FL_RED);
-        status_box->redraw();
-        Fl::add_timeout(4.0, clear_status_cb);
-        return;
-    }
+    if (!check_output_dir() || !check_cv_engine()) return;
 
-    // Set global flags from UI
-    g_use_multithreading = multithread_toggle->value();
-
-    b_input_files->deactivate();
-    b_output_dir->deactivate();
-    startb->deactivate();
-    opencv_toggle->deactivate();
-    multithread_toggle->deactivate();
-    tesseract_toggle->deactivate();
+    read_options();
+    lock_controls();
     
     progress_bar->show();
     progress_bar->value(0);
 
     if (status_box) {
-        status_box->copy_label("Calculating workload...");
+        status_box->copy_label("Processing...");
         status_box->labelcolor(FL_FOREGROUND_COLOR);
         status_box->redraw();
     }
-    Fl::check();
 
-    // Calculate Total Work Units (Synchronous, fast)
-    g_total_work_units = 0;
+    // Provisional Total Work Units; the background pre-scan refines them
     g_processed_work_units = 0;
+    g_processing_done = false;
+    g_total_work_units = (int)input_files_vec.size() * estimate_work_units("unknown", 1, g_use_opencv);
     
-    bool use_opencv = opencv_toggle->value();
-    
-    for (const auto& path : input_files_vec) {
-        std::string ftype = detect_file_type(path);
-        int pages = 1;
-        
-        if (ftype == "pdf" || ftype == "djvu") {
-            pages = get_page_count(path, ftype);
-        }
-        
-        if (use_opencv) {
-            if ((ftype == "pdf" && support_PDF_RENDER) || 
-                (ftype == "djvu" && support_DJVU) ||
-                ((support_DOC || support_EPUB) && support_PDF_RENDER)) {
-                g_total_work_units += pages * 2; // Render + Process
-            } else {
-                g_total_work_units += 6; // Avg extraction + processing
-            }
-        } else {
-            if (ftype == "pdf") {
-                g_total_work_units += 1; 
-            } else if (ftype == "djvu") {
-                g_total_work_units += pages;
-            } else {
-                g_total_work_units += 1;
-            }
-        }
+    g_input_scans.clear();
+    dashboard_reset();
+    std::set<std::string> folder_names;
+    for (size_t i = 0; i < input_files_vec.size(); i++) {
+        g_input_scans.emplace_back(new InputScan());
+        g_input_scans.back()->folder_name = unique_folder_name(output_folder_name(input_files_vec[i]), folder_names);
+        dashboard_add_doc(input_files_vec[i]);
     }
-    
-    if (g_total_work_units == 0) g_total_work_units = 1;
 
     // Start UI Update Loop
     Fl::add_timeout(0.05, update_ui_cb);
@@ -1055,10 +2663,322 @@ static void start_cb (Fl_Widget* o) {
     worker.detach();
 }
 
+// ==========================================
+// Hot Folder (Watch Mode)
+// ==========================================
+// inotify reports new and rewritten files in the watched directories. A file
+// is queued once it is closed after writing and its size has stopped
+// changing (or it has been stable for WATCH_STABLE_SECONDS, for writers that
+// never close). Finished inputs are moved into a "processed" subfolder.
+// Files in the "priority" subfolder of a watched folder always take the
+// interactive lane.
+
+const double WATCH_STABLE_SECONDS = 2.0;
+const char* WATCH_DONE_DIR = "processed";
+const char* WATCH_PRIORITY_DIR = "priority";
+
+std::vector<std::string> g_watch_dirs;
+std::atomic<bool> g_watch_running{false};
+std::atomic<bool> g_watch_stop{false};
+std::atomic<int> g_watch_processed{0};
+std::atomic<int> g_watch_failed{0}; // Watched folders inotify refused
+std::string g_watch_error;          // Why watching stopped on its own (g_watch_mutex)
+
+std::mutex g_watch_mutex;
+std::condition_variable g_watch_cv;
+std::deque<std::string> g_watch_queue;
+std::string g_watch_label;
+
+// Sized and classified documents waiting for their lane (under g_watch_mutex)
+struct LaneItem {
+    std::string path;
+    std::string ftype;
+    std::string folder_name;
+    std::shared_ptr<DocProgress> doc;
+};
+std::deque<LaneItem> g_lane_queues[2]; // Indexed by Lane
+std::set<std::string> g_watch_folders; // Output folders of queued and running documents
+
+struct PendingFile {
+    off_t size = -1;
+    bool closed = false;
+    std::chrono::steady_clock::time_point changed;
+};
+
+static void watch_track(std::map<std::string, PendingFile>& pending, const std::string& path, bool closed) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return;
+    PendingFile& p = pending[path];
+    if (st.st_size != p.size) {
+        p.size = st.st_size;
+        p.changed = std::chrono::steady_clock::now();
+    }
+    if (closed) p.closed = true;
+}
+
+void watch_inotify_thread() {
+    auto give_up = [](const std::string& why) {
+        std::cerr << "[watch] " << why << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(g_watch_mutex);
+            g_watch_error = why;
+        }
+        g_watch_stop = true;
+        g_watch_cv.notify_all();
+    };
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        give_up(std::string("inotify unavailable: ") + strerror(errno));
+        return;
+    }
+
+    std::map<int, std::string> wd_dirs;
+    std::map<std::string, PendingFile> pending;
+
+    std::vector<std::string> dirs;
+    for (const auto& d : g_watch_dirs) {
+        std::string priority = d + "/" + WATCH_PRIORITY_DIR;
+        mkdir(priority.c_str(), 0777);
+        dirs.push_back(d);
+        dirs.push_back(priority);
+    }
+
+    for (const auto& d : dirs) {
+        int wd = inotify_add_watch(fd, d.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+        if (wd < 0) {
+            // Bad path, no permission or out of watches (fs.inotify.max_user_watches)
+            std::cerr << "[watch] Cannot watch " << d << ": " << strerror(errno) << std::endl;
+            g_watch_failed++;
+            continue;
+        }
+        wd_dirs[wd] = d;
+
+        // Files already waiting in the folder are picked up too
+        DIR* dir = opendir(d.c_str());
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (entry->d_name[0] == '.') continue;
+                watch_track(pending, d + "/" + entry->d_name, true);
+            }
+            closedir(dir);
+        }
+    }
+
+    if (wd_dirs.empty()) {
+        close(fd);
+        give_up("Could not watch any of the chosen folders");
+        return;
+    }
+
+    alignas(struct inotify_event) char buf[4096];
+    while (!g_watch_stop) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 250) > 0) {
+            ssize_t len;
+            while ((len = read(fd, buf, sizeof(buf))) > 0) {
+                for (char* ptr = buf; ptr < buf + len; ) {
+                    struct inotify_event* ev = (struct inotify_event*)ptr;
+                    ptr += sizeof(struct inotify_event) + ev->len;
+                    if (ev->len == 0 || ev->name[0] == '.' || (ev->mask & IN_ISDIR)) continue;
+                    auto it = wd_dirs.find(ev->wd);
+                    if (it == wd_dirs.end()) continue;
+                    bool closed = (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0;
+                    watch_track(pending, it->second + "/" + ev->name, closed);
+                }
+            }
+        }
+
+        // Promote files whose size has settled
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = pending.begin(); it != pending.end(); ) {
+            struct stat st;
+            if (stat(it->first.c_str(), &st) != 0) {
+                it = pending.erase(it);
+                continue;
+            }
+            PendingFile& p = it->second;
+            double stable = std::chrono::duration<double>(now - p.changed).count();
+            if (st.st_size != p.size) {
+                p.size = st.st_size;
+                p.changed = now;
+            } else if (p.size > 0 && (p.closed || stable >= WATCH_STABLE_SECONDS)) {
+                {
+                    std::lock_guard<std::mutex> lock(g_watch_mutex);
+                    g_watch_queue.push_back(it->first);
+                }
+                g_watch_cv.notify_all(); // Shared with the lane threads
+                it = pending.erase(it);
+                continue;
+            }
+            ++it;
+        }
+    }
+
+    close(fd);
+}
+
+static void watch_lane_thread(Lane lane) {
+    std::deque<LaneItem>& queue = g_lane_queues[(int)lane];
+    while (true) {
+        LaneItem item;
+        {
+            std::unique_lock<std::mutex> lock(g_watch_mutex);
+            g_watch_cv.wait(lock, [&] { return g_watch_stop || !queue.empty(); });
+            if (g_watch_stop) break;
+            item = queue.front();
+            queue.pop_front();
+        }
+
+        process_input_file(item.path, item.ftype, item.doc.get(), item.folder_name);
+        {
+            std::lock_guard<std::mutex> lock(g_watch_mutex);
+            g_watch_folders.erase(item.folder_name);
+        }
+
+        size_t slash = item.path.find_last_of('/');
+        std::string done_dir = item.path.substr(0, slash) + "/" + WATCH_DONE_DIR;
+        mkdir(done_dir.c_str(), 0777);
+        rename(item.path.c_str(), (done_dir + item.path.substr(slash)).c_str());
+        g_watch_processed++;
+    }
+}
+
+void watch_mode_thread() {
+    trace_open();
+    std::thread watcher(watch_inotify_thread);
+    std::thread bulk(watch_lane_thread, Lane::Bulk);
+    std::thread interactive(watch_lane_thread, Lane::Interactive);
+
+    std::thread tuner;
+    if (g_use_autotune) {
+        g_autotune_stop = false;
+        tuner = std::thread(autotune_thread_fn);
+    }
+
+    // Size and classify each settled file, then hand it to its lane
+    while (true) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(g_watch_mutex);
+            g_watch_cv.wait(lock, [] { return g_watch_stop || !g_watch_queue.empty(); });
+            if (g_watch_stop) break;
+            path = g_watch_queue.front();
+            g_watch_queue.pop_front();
+        }
+
+        LaneItem item;
+        item.path = path;
+        item.ftype = detect_file_type(path);
+        dashboard_trim();
+        item.doc = dashboard_add_doc(path);
+        if (item.ftype == "pdf" || item.ftype == "djvu") item.doc->pages = get_page_count(path, item.ftype);
+
+        std::string folder = path.substr(0, path.find_last_of('/'));
+        bool priority = folder.substr(folder.find_last_of('/') + 1) == WATCH_PRIORITY_DIR;
+        item.doc->lane = priority ? Lane::Interactive : classify_lane(path, std::max(1, item.doc->pages.load()));
+        {
+            std::lock_guard<std::mutex> lock(g_watch_mutex);
+            item.folder_name = unique_folder_name(output_folder_name(path), g_watch_folders);
+            g_lane_queues[(int)item.doc->lane.load()].push_back(item);
+        }
+        g_watch_cv.notify_all();
+    }
+
+    if (tuner.joinable()) {
+        g_autotune_stop = true;
+        tuner.join();
+    }
+    bulk.join();
+    interactive.join();
+    watcher.join();
+    trace_close();
+    g_watch_running = false;
+}
+
+void update_watch_ui_cb(void*) {
+    update_dashboard();
+    if (!g_watch_running) {
+        watchb->label("Watch");
+        unlock_controls();
+        if (status_box) {
+            {
+                std::lock_guard<std::mutex> lock(g_watch_mutex);
+                g_watch_label = g_watch_error.empty() ? "Stopped watching." : g_watch_error + "!";
+            }
+            status_box->label(g_watch_label.c_str());
+            status_box->labelcolor(g_watch_error.empty() ? FL_FOREGROUND_COLOR : FL_RED);
+            status_box->redraw();
+            Fl::add_timeout(4.0, clear_status_cb);
+        }
+        return;
+    }
+
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(g_watch_mutex);
+        queued = g_watch_queue.size() + g_lane_queues[0].size() + g_lane_queues[1].size();
+    }
+    g_watch_label = "Watching " + std::to_string(g_watch_dirs.size()) + " folder(s): " +
+                    std::to_string(g_watch_processed.load()) + " done, " + std::to_string(queued) + " queued";
+    if (g_watch_failed > 0) g_watch_label += ", " + std::to_string(g_watch_failed.load()) + " not watchable (see log)";
+    status_box->label(g_watch_label.c_str());
+    status_box->redraw();
+    Fl::repeat_timeout(0.5, update_watch_ui_cb);
+}
+
+static void watch_cb(Fl_Widget* o) {
+    if (g_watch_running) {
+        g_watch_stop = true;
+        g_watch_cv.notify_all();
+        watchb->deactivate();
+        return;
+    }
+    if (!check_output_dir()) return;
+
+    Fl_Native_File_Chooser wfc;
+    wfc.title("Choose folders to watch for new documents");
+    wfc.type(Fl_Native_File_Chooser::BROWSE_MULTI_DIRECTORY);
+    wfc.directory(".");
+    if (wfc.show() != 0) return;
+
+    g_watch_dirs.clear();
+    for (int i = 0; i < wfc.count(); i++) {
+        g_watch_dirs.push_back(std::string(wfc.filename(i)));
+    }
+    if (g_watch_dirs.empty() || !check_cv_engine()) return;
+
+    read_options();
+    lock_controls();
+    watchb->label("Stop");
+    watchb->activate();
+
+    g_watch_queue.clear();
+    for (auto& queue : g_lane_queues) queue.clear();
+    g_watch_folders.clear();
+    g_watch_processed = 0;
+    g_watch_failed = 0;
+    g_watch_error.clear();
+    g_watch_stop = false;
+    g_watch_running = true;
+
+    status_box->labelcolor(FL_FOREGROUND_COLOR);
+    dashboard_reset();
+    Fl::add_timeout(0.05, update_watch_ui_cb);
+
+    std::thread worker(watch_mode_thread);
+    worker.detach();
+}
+
 // ==========================================
 // Main
 // ==========================================
+// Harnesses in tools/ include this file with DOCIMG_NO_MAIN defined
+#ifndef DOCIMG_NO_MAIN
 int main(int argc, char **argv) {
+    prefork_init();
+
     wstart = new Fl_Double_Window(600, 256);
 
     {
@@ -1076,7 +2996,7 @@ int main(int argc, char **argv) {
     }
     wstart->end();
 
-    wmain = new Fl_Double_Window(512, 380); // Increased height slightly to fit the new checkbox
+    wmain = new Fl_Double_Window(512, 665); // Increased height slightly to fit the new checkboxes
 
     {
         new Fl_Box(50, 20, 200, 10, "Choose documents to extract images from.");
@@ -1098,31 +3018,86 @@ int main(int argc, char **argv) {
         tesseract_toggle->tooltip("More accurate detection, but slower. Requires OpenCV to be enabled.");
         tesseract_toggle->value(0);
         tesseract_toggle->deactivate();
-
-        multithread_toggle = new Fl_Check_Button(10, 200, 300, 24, "Enable Multithreading");
+        tesseract_toggle->callback(tesseract_toggle_cb);
+
+        deferocr_toggle = new Fl_Check_Button(50, 200, 300, 24, "Write clear figures first, OCR the rest later");
+        deferocr_toggle->tooltip("Figures that need no OCR are saved as soon as their page is scanned. Ambiguous regions are checked by low-priority OCR workers before the document finishes.");
+        deferocr_toggle->value(0);
+        deferocr_toggle->deactivate();
+
+        vector_toggle = new Fl_Check_Button(30, 225, 300, 24, "Save PDF figures as vector (SVG)");
+        vector_toggle->tooltip("Crops figures from the original PDF page instead of the 200 dpi render. Requires OpenCV to be enabled.");
+        vector_toggle->value(0);
+        vector_toggle->deactivate();
+
+        xycut_toggle = new Fl_Check_Button(30, 250, 300, 24, "Use XY-cut layout analysis (faster)");
+        xycut_toggle->tooltip("Finds figure candidates from row/column projection profiles of a downsampled page instead of full-resolution contours. Requires OpenCV to be enabled.");
+        xycut_toggle->value(0);
+        xycut_toggle->deactivate();
+
+        sauvola_toggle = new Fl_Check_Button(30, 275, 300, 24, "Use Sauvola binarisation (faster)");
+        sauvola_toggle->tooltip("Binarises each page once with a Sauvola threshold computed from running window sums, instead of a Gaussian adaptive threshold per candidate region. Requires OpenCV to be enabled.");
+        sauvola_toggle->value(0);
+        sauvola_toggle->deactivate();
+
+        prefork_toggle = new Fl_Check_Button(30, 300, 300, 24, "Isolate detection in worker processes");
+        prefork_toggle->tooltip("Runs OpenCV/Tesseract in restartable worker processes fed through shared memory, so a crash skips one page instead of ending the batch. Requires OpenCV to be enabled.");
+        prefork_toggle->value(0);
+        prefork_toggle->deactivate();
+
+        pagestore_toggle = new Fl_Check_Button(30, 325, 300, 24, "Keep rendered PDF pages in memory");
+        pagestore_toggle->tooltip("Renders and detects PDF pages concurrently, holding pending pages zstd-compressed in memory instead of PNG files. Spills to disk past DOCIMG_PAGE_STORE_MB (default 512). Requires OpenCV to be enabled.");
+        pagestore_toggle->value(0);
+        pagestore_toggle->deactivate();
+
+        multithread_toggle = new Fl_Check_Button(10, 350, 300, 24, "Enable Multithreading");
         multithread_toggle->tooltip("Use all CPU cores for rendering and processing. Disable if system is unstable.");
         multithread_toggle->value(1); // Default ON
+        multithread_toggle->callback(multithread_toggle_cb);
+
+        autotune_toggle = new Fl_Check_Button(30, 375, 300, 24, "Auto-tune thread counts");
+        autotune_toggle->tooltip("Adjusts render and detection workers during the run to maximise pages/second. Decisions are logged to stdout.");
+        autotune_toggle->value(0);
+
+        speculate_toggle = new Fl_Check_Button(30, 400, 300, 24, "Re-run straggling pages speculatively");
+        speculate_toggle->tooltip("When a page takes far longer than the document's typical page and workers are idle, starts a second copy (PDF pages rendered by pdftocairo, detection in worker processes with the other layout engine) and keeps whichever finishes first. The two layout engines can find different figures, so with this on the figures of a slow page depend on which copy wins.");
+        speculate_toggle->value(0);
 
-        Fl_Button* quitb = new Fl_Button(512-74, 380-42, 64, 32, "Exit");
+        seen_toggle = new Fl_Check_Button(10, 425, 300, 24, "Skip figures seen in earlier runs");
+        seen_toggle->tooltip("Keeps a perceptual-hash index of every figure in the output directory. Near-identical figures from later documents or runs are listed in duplicates.tsv instead of being saved again.");
+        seen_toggle->value(0);
+
+        Fl_Button* quitb = new Fl_Button(512-74, 665-42, 64, 32, "Exit");
         quitb->callback(quit_cb);
 
         startb = new Fl_Button(512-74, 10, 64, 32, "Start");
         startb->callback(start_cb);
 
-        progress_bar = new Fl_Progress(10, 240, 492, 24);
+        watchb = new Fl_Button(512-74, 50, 64, 32, "Watch");
+        watchb->tooltip("Watch folders for new documents and process each one as soon as it is fully written.");
+        watchb->callback(watch_cb);
+
+        progress_bar = new Fl_Progress(10, 465, 492, 24);
         progress_bar->minimum(0);
         progress_bar->maximum(100);
         progress_bar->value(0);
         progress_bar->hide();
 
-        status_box = new Fl_Box(10, 270, 492, 24, "");
+        status_box = new Fl_Box(10, 495, 492, 24, "");
         status_box->align(FL_ALIGN_CENTER | FL_ALIGN_INSIDE);
         status_box->labelfont(FL_BOLD);
         status_box->labelsize(16);
+
+        dashboard = new Fl_Text_Display(10, 525, 420, 130);
+        dashboard->buffer(new Fl_Text_Buffer());
+        dashboard->textfont(FL_COURIER);
+        dashboard->textsize(11);
+        dashboard->tooltip("Live throughput: pages/s, per-stage queue and workers, CPU and memory, OCR share of detection time, and per-document progress.");
     }
     wmain->end();
 
     wstart->show(argc, argv);
 
     return Fl::run();
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,312 @@
+// Cost model for capacity planning.
+//
+// Fits, per document type, wall time and CPU time as linear functions of what
+// is known about a document before processing it (pages and size), from the
+// cost_ledger.jsonl the application writes into its output directory. Given
+// a manifest (one document path per line) it predicts the total runtime and
+// how many nodes finish it within a deadline.
+//
+// Build: g++ -std=c++17 -O2 tools/cost_model.cpp -o cost_model
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+// ==========================================
+// Ledger Loading
+// ==========================================
+
+struct Entry {
+    std::string type;
+    double pages;
+    double mb;      // Input size
+    double wall;
+    double cpu;     // This process plus subprocesses
+    bool opencv;
+    bool ocr;
+};
+
+// Position just past "key": (whitespace allowed), or npos
+static size_t json_value(const std::string& line, const std::string& key) {
+    size_t pos = line.find("\"" + key + "\"");
+    if (pos == std::string::npos) return pos;
+    pos += key.size() + 2;
+    while (pos < line.size() && (line[pos] == ' ' || line[pos] == ':')) pos++;
+    return pos;
+}
+
+static std::string json_string(const std::string& line, const std::string& key) {
+    size_t pos = json_value(line, key);
+    if (pos == std::string::npos || pos >= line.size() || line[pos] != '"') return "";
+    std::string out;
+    for (pos++; pos < line.size() && line[pos] != '"'; pos++) {
+        if (line[pos] == '\\' && pos + 1 < line.size()) pos++;
+        out += line[pos];
+    }
+    return out;
+}
+
+static double json_number(const std::string& line, const std::string& key) {
+    size_t pos = json_value(line, key);
+    if (pos == std::string::npos) return 0;
+    return atof(line.c_str() + pos);
+}
+
+static bool json_bool(const std::string& line, const std::string& key) {
+    size_t pos = json_value(line, key);
+    return pos != std::string::npos && line.compare(pos, 4, "true") == 0;
+}
+
+// Entries marked shared overlapped with another document (interactive and
+// bulk lanes), so their costs are mixed; they are counted in shared and skipped
+bool load_ledger(const std::string& path, int want_opencv, int want_ocr, std::vector<Entry>& entries, int& shared) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        if (json_bool(line, "shared")) {
+            shared++;
+            continue;
+        }
+        Entry e;
+        e.type = json_string(line, "type");
+        e.pages = json_number(line, "pages");
+        e.mb = json_number(line, "bytes") / 1e6;
+        e.wall = json_number(line, "wall");
+        e.cpu = json_number(line, "cpu") + json_number(line, "child_cpu");
+        e.opencv = json_bool(line, "opencv");
+        e.ocr = json_bool(line, "ocr");
+        if (want_opencv >= 0 && e.opencv != (want_opencv == 1)) continue;
+        if (want_ocr >= 0 && e.ocr != (want_ocr == 1)) continue;
+        entries.push_back(e);
+    }
+    return !entries.empty();
+}
+
+// ==========================================
+// Fitting
+// ==========================================
+// cost = a + b * pages + c * MB, by ridge-regularised least squares so that
+// small or collinear samples still give a usable (if rough) model.
+
+struct Model {
+    std::array<double, 3> coef = {0, 0, 0};
+    int samples = 0;
+    double r2 = 0;
+    double mean_abs_error = 0;
+
+    double predict(double pages, double mb) const {
+        return std::max(0.0, coef[0] + coef[1] * pages + coef[2] * mb);
+    }
+};
+
+static Model fit(const std::vector<const Entry*>& rows, double Entry::*target) {
+    Model m;
+    m.samples = (int)rows.size();
+    if (rows.empty()) return m;
+
+    double ata[3][4] = {};
+    for (const Entry* e : rows) {
+        double x[3] = {1.0, e->pages, e->mb};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) ata[i][j] += x[i] * x[j];
+            ata[i][3] += x[i] * (e->*target);
+        }
+    }
+    for (int i = 1; i < 3; i++) ata[i][i] += 1e-6 * (1.0 + ata[i][i]);
+
+    // Gaussian elimination with partial pivoting
+    for (int col = 0; col < 3; col++) {
+        int pivot = col;
+        for (int r = col + 1; r < 3; r++) {
+            if (std::fabs(ata[r][col]) > std::fabs(ata[pivot][col])) pivot = r;
+        }
+        std::swap(ata[col], ata[pivot]);
+        if (std::fabs(ata[col][col]) < 1e-12) continue;
+        for (int r = 0; r < 3; r++) {
+            if (r == col) continue;
+            double f = ata[r][col] / ata[col][col];
+            for (int k = col; k < 4; k++) ata[r][k] -= f * ata[col][k];
+        }
+    }
+    for (int i = 0; i < 3; i++) m.coef[i] = std::fabs(ata[i][i]) < 1e-12 ? 0 : ata[i][3] / ata[i][i];
+
+    double mean = 0;
+    for (const Entry* e : rows) mean += e->*target;
+    mean /= rows.size();
+    double ss_res = 0, ss_tot = 0;
+    for (const Entry* e : rows) {
+        double err = (e->*target) - m.predict(e->pages, e->mb);
+        ss_res += err * err;
+        ss_tot += ((e->*target) - mean) * ((e->*target) - mean);
+        m.mean_abs_error += std::fabs(err);
+    }
+    m.mean_abs_error /= rows.size();
+    m.r2 = ss_tot > 0 ? 1.0 - ss_res / ss_tot : 1.0;
+    return m;
+}
+
+struct TypeModel {
+    Model wall, cpu;
+    double pages_per_mb = 0; // For manifest entries whose page count is unknown
+};
+
+const int MIN_SAMPLES_PER_TYPE = 5; // Fewer than this: use the all-types model
+
+std::map<std::string, TypeModel> fit_models(const std::vector<Entry>& entries) {
+    std::map<std::string, std::vector<const Entry*>> by_type;
+    for (const auto& e : entries) {
+        by_type[e.type].push_back(&e);
+        by_type["*"].push_back(&e);
+    }
+
+    std::map<std::string, TypeModel> models;
+    for (const auto& group : by_type) {
+        TypeModel tm;
+        tm.wall = fit(group.second, &Entry::wall);
+        tm.cpu = fit(group.second, &Entry::cpu);
+        double pages = 0, mb = 0;
+        for (const Entry* e : group.second) {
+            pages += e->pages;
+            mb += e->mb;
+        }
+        tm.pages_per_mb = mb > 0 ? pages / mb : 0;
+        models[group.first] = tm;
+    }
+    return models;
+}
+
+// ==========================================
+// Manifest
+// ==========================================
+
+// Same type names as the application's detect_file_type, from the extension
+static std::string type_from_path(const std::string& path) {
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == "pdf") return "pdf";
+    if (ext == "djvu" || ext == "djv") return "djvu";
+    if (ext == "doc") return "doc_legacy";
+    if (ext == "docx" || ext == "odt" || ext == "epub" || ext == "pptx" || ext == "odp" || ext == "zip") return "zip_container";
+    return "unknown";
+}
+
+static int read_page_count(const std::string& path, const std::string& type) {
+    std::string cmd;
+    if (type == "pdf") cmd = "pdfinfo '" + path + "' 2>/dev/null | awk '/^Pages:/ {print $2}'";
+    else if (type == "djvu") cmd = "djvused -e 'n' '" + path + "' 2>/dev/null";
+    else return 0;
+
+    FILE* pipe = popen(cmd.c_str(), "r");
+    if (!pipe) return 0;
+    char buffer[32];
+    int pages = fgets(buffer, sizeof(buffer), pipe) ? atoi(buffer) : 0;
+    pclose(pipe);
+    return pages;
+}
+
+static void print_model(const std::string& name, const TypeModel& tm) {
+    std::cout << "  " << std::left << std::setw(14) << name << std::right << std::setw(5) << tm.wall.samples
+              << "  wall = " << std::setw(7) << tm.wall.coef[0] << " + " << std::setw(7) << tm.wall.coef[1]
+              << "/page + " << std::setw(7) << tm.wall.coef[2] << "/MB   R2 " << std::setw(5) << tm.wall.r2
+              << "  MAE " << tm.wall.mean_abs_error << " s" << std::endl;
+}
+
+static void usage() {
+    std::cerr << "Usage: cost_model LEDGER.jsonl [options]\n"
+                 "  --opencv 0|1       only use documents run without/with OpenCV\n"
+                 "  --ocr 0|1          only use documents run without/with OCR\n"
+                 "  --manifest FILE    predict the cost of the documents listed in FILE\n"
+                 "  --hours H          deadline for the manifest, to size the node count (default 24)\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    int want_opencv = -1, want_ocr = -1;
+    std::string manifest;
+    double hours = 24;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : "";
+        if (arg == "--opencv") { want_opencv = atoi(val); i++; }
+        else if (arg == "--ocr") { want_ocr = atoi(val); i++; }
+        else if (arg == "--manifest") { manifest = val; i++; }
+        else if (arg == "--hours") { hours = atof(val); i++; }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<Entry> entries;
+    int shared = 0;
+    if (!load_ledger(argv[1], want_opencv, want_ocr, entries, shared)) {
+        std::cerr << "No matching documents in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, TypeModel> models = fit_models(entries);
+    std::cout << entries.size() << " document(s) in the ledger";
+    if (shared) std::cout << " (" << shared << " that overlapped another document skipped)";
+    std::cout << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& m : models) print_model(m.first == "*" ? "(all types)" : m.first, m.second);
+
+    if (manifest.empty()) return 0;
+
+    std::ifstream list(manifest);
+    if (!list) {
+        std::cerr << "Could not read " << manifest << std::endl;
+        return 1;
+    }
+
+    int docs = 0, missing = 0;
+    double total_wall = 0, total_cpu = 0, total_pages = 0;
+    std::string path;
+    while (std::getline(list, path)) {
+        if (path.empty()) continue;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            missing++;
+            continue;
+        }
+        std::string type = type_from_path(path);
+        auto it = models.find(type);
+        if (it == models.end() || it->second.wall.samples < MIN_SAMPLES_PER_TYPE) it = models.find("*");
+        const TypeModel& tm = it->second;
+
+        double mb = st.st_size / 1e6;
+        double pages = read_page_count(path, type);
+        if (pages <= 0) pages = std::max(1.0, std::round(mb * tm.pages_per_mb));
+
+        total_wall += tm.wall.predict(pages, mb);
+        total_cpu += tm.cpu.predict(pages, mb);
+        total_pages += pages;
+        docs++;
+    }
+
+    double deadline = hours * 3600.0;
+    std::cout << std::setprecision(1);
+    std::cout << "Manifest: " << docs << " document(s), " << (long)total_pages << " page(s)";
+    if (missing) std::cout << ", " << missing << " not found";
+    std::cout << std::endl;
+    std::cout << "  predicted runtime on one node: " << total_wall / 3600.0 << " h (CPU " << total_cpu / 3600.0 << " h)" << std::endl;
+    std::cout << "  nodes for " << hours << " h: " << std::max(1, (int)std::ceil(total_wall / deadline)) << std::endl;
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Reference consumer for the shared-memory figure ring.
+//
+// Attaches to the ring the application publishes figures to (the name given
+// in DOCIMG_FIGURE_RING), prints one line per figure and optionally saves it
+// as PGM/PPM. Pixels are read in place and released after use; --delay slows
+// the consumer down to exercise the producer's back-pressure.
+//
+// Build: g++ -std=c++17 -O2 tools/figure_ring_dump.cpp -o figure_ring_dump -lrt
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../figure_ring.h"
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int) { g_stop = 1; }
+
+// Map the ring, waiting for the producer to create and initialise it
+static FigureRingHeader* attach(const std::string& name) {
+    while (!g_stop) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size > FIGURE_RING_HEADER_BYTES) {
+            void* mem = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mem == MAP_FAILED) return nullptr;
+            FigureRingHeader* header = (FigureRingHeader*)mem;
+            while (!g_stop && header->magic != FIGURE_RING_MAGIC) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return header->version == FIGURE_RING_VERSION ? header : nullptr;
+        }
+        if (fd >= 0) close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    return nullptr;
+}
+
+// Binary PGM/PPM; the ring holds BGR, PPM wants RGB
+static void save_pnm(const std::string& path, const FigureRecord* rec) {
+    std::ofstream out(path, std::ios::binary);
+    out << (rec->channels == 1 ? "P5" : "P6") << "\n" << rec->cols << " " << rec->rows << "\n255\n";
+    const unsigned char* pixels = (const unsigned char*)(rec + 1);
+    std::vector<unsigned char> row(rec->cols * 3);
+    for (int y = 0; y < rec->rows; y++) {
+        const unsigned char* src = pixels + (size_t)y * rec->step;
+        if (rec->channels == 1) {
+            out.write((const char*)src, rec->cols);
+            continue;
+        }
+        for (int x = 0; x < rec->cols; x++) {
+            row[x * 3] = src[x * rec->channels + 2];
+            row[x * 3 + 1] = src[x * rec->channels + 1];
+            row[x * 3 + 2] = src[x * rec->channels];
+        }
+        out.write((const char*)row.data(), row.size());
+    }
+}
+
+static void usage() {
+    std::cerr << "Usage: figure_ring_dump NAME [options]\n"
+                 "  --save DIR     write every figure to DIR as PGM/PPM\n"
+                 "  --delay MS     hold each figure MS milliseconds before releasing it\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string name = argv[1];
+    std::string save_dir;
+    int delay_ms = 0;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : "";
+        if (arg == "--save") { save_dir = val; i++; }
+        else if (arg == "--delay") { delay_ms = atoi(val); i++; }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    if (!save_dir.empty()) mkdir(save_dir.c_str(), 0777);
+
+    FigureRingHeader* header = attach(name);
+    if (!header) {
+        std::cerr << "Could not attach to " << name << std::endl;
+        return 1;
+    }
+    int32_t none = 0;
+    if (!header->consumer_pid.compare_exchange_strong(none, getpid())) {
+        pid_t other = none;
+        if (kill(other, 0) == 0) {
+            std::cerr << name << " already has a consumer (pid " << other << ")" << std::endl;
+            return 1;
+        }
+        header->consumer_pid = getpid(); // Take over from a consumer that died
+    }
+
+    unsigned char* data = (unsigned char*)header + FIGURE_RING_HEADER_BYTES;
+    long figures = 0;
+    while (!g_stop) {
+        uint32_t seen = header->head_seq.load(std::memory_order_acquire);
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        if (tail == header->head.load(std::memory_order_acquire)) {
+            figure_ring_wait(header->head_seq, seen, 500);
+            continue;
+        }
+
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        uint64_t pos = tail % header->capacity;
+        const FigureRecord* rec = (const FigureRecord*)(data + pos);
+        bool valid = rec->size > 0 && rec->size % FIGURE_RING_ALIGN == 0 && rec->size <= header->capacity - pos &&
+                     rec->size <= head - tail;
+        if (valid && rec->kind == FIGURE_RECORD) {
+            valid = rec->size >= sizeof(FigureRecord) && rec->rows >= 0 && rec->cols >= 0 &&
+                    (rec->channels == 1 || rec->channels == 3 || rec->channels == 4) &&
+                    (uint64_t)rec->step >= (uint64_t)rec->cols * rec->channels &&
+                    (uint64_t)rec->rows * rec->step <= rec->size - sizeof(FigureRecord);
+        }
+        if (!valid) {
+            // Advancing by a bad size would spin forever or walk off the mapping
+            std::cerr << "Corrupt record at offset " << pos << " (size " << rec->size << "), detaching" << std::endl;
+            break;
+        }
+        if (rec->kind == FIGURE_RECORD) {
+            figures++;
+            std::cout << rec->name << "\tpage " << rec->page << "\t" << rec->x << "," << rec->y << " "
+                      << rec->width << "x" << rec->height << "\t" << rec->cols << "x" << rec->rows
+                      << "x" << rec->channels << std::endl;
+            if (!save_dir.empty()) {
+                std::string base = rec->name;
+                base = base.substr(base.find_last_of('/') + 1);
+                save_pnm(save_dir + "/" + base + (rec->channels == 1 ? ".pgm" : ".ppm"), rec);
+            }
+            if (delay_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        }
+
+        header->tail.store(tail + rec->size, std::memory_order_release);
+        figure_ring_wake(header->tail_seq);
+    }
+
+    header->consumer_pid = 0;
+    std::cerr << figures << " figure(s) received" << std::endl;
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Performance fuzzing harness.
+//
+// A libFuzzer target whose objective is cost rather than crashes: every
+// input is decoded into a page (or a parser document), run through the same
+// code the application uses, and timed. Inputs that exceed the per-page time
+// or memory threshold are copied into a regression corpus. The time and
+// memory buckets an input reaches are also reported to libFuzzer as extra
+// coverage, so inputs that are slower than anything seen before are kept and
+// mutated further, steering the search towards pathological pages (dense
+// halftones, huge contour sets, deep XY-cut recursion).
+//
+// Input layout (first byte selects the target):
+//   0  page:   format, width/16 (2 bytes), height/16 (2 bytes), tile width,
+//              layout engine (bit 0) and binariser (bit 1), then tile
+//              pixels repeated across the page;
+//              inputs starting with an image signature are decoded instead
+//   1  pdftohtml -xml placement parser (parse_placed_images)
+//   2  rendered page file name parser (page_number_from_filename)
+//
+// Environment:
+//   DOCIMG_FUZZ_PAGE_MS  time threshold per input (default 2000)
+//   DOCIMG_FUZZ_PAGE_MB  peak RSS growth threshold per input (default 256)
+//   DOCIMG_FUZZ_CORPUS   regression corpus folder (default perf_corpus)
+//   DOCIMG_FUZZ_OCR=1    also verify candidates with Tesseract
+//
+// Build (clang, same libraries as the application and its detection module):
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer tools/perf_fuzz.cpp -o perf_fuzz
+//       `fltk-config --cflags --ldflags` `pkg-config --cflags --libs opencv4`
+//       -ltesseract -llept -lzstd -ldl -lrt -pthread
+// Run:
+//   ./perf_fuzz -timeout=30 -rss_limit_mb=4096 seeds/
+// Replay the regression corpus:
+//   ./perf_fuzz perf_corpus/*
+#define DOCIMG_NO_MAIN
+#include "../main.cpp"
+#include "../cv_engine.cpp" // Linked in directly; the harness does not dlopen it
+#include <cstring>
+
+// ==========================================
+// Cost Objective
+// ==========================================
+
+// log2 buckets of milliseconds and MB, exposed to libFuzzer as coverage
+#ifdef __clang__
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t g_cost_counters[3][32];
+
+static long env_long(const char* name, long fallback) {
+    const char* value = getenv(name);
+    return (value && *value) ? atol(value) : fallback;
+}
+
+static long max_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int log2_bucket(double value) {
+    int bucket = 0;
+    while (value >= 1.0 && bucket < 31) {
+        value /= 2.0;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void save_to_corpus(const uint8_t* data, size_t size, const char* reason, double ms, long mb) {
+    std::string dir = getenv("DOCIMG_FUZZ_CORPUS") ? getenv("DOCIMG_FUZZ_CORPUS") : "perf_corpus";
+    mkdir(dir.c_str(), 0777);
+
+    // FNV-1a names the file, so replays of the same input overwrite it
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 1099511628211ULL;
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", (unsigned long long)hash);
+
+    std::ofstream out(dir + name, std::ios::binary);
+    out.write((const char*)data, size);
+    std::cerr << "[perf_fuzz] " << reason << ": " << std::fixed << std::setprecision(1) << ms
+              << " ms, +" << mb << " MB peak RSS, target " << (int)data[0] << " -> " << dir << name << std::endl;
+}
+
+// ==========================================
+// Targets
+// ==========================================
+
+// Build a page from the input: either a real image, or a tile pattern
+// repeated over a page-sized canvas
+static cv::Mat page_from_input(const uint8_t* data, size_t size) {
+    std::vector<uchar> bytes(data, data + size);
+    static const struct { const char* magic; size_t len; } SIGNATURES[] = {
+        {"\x89PNG", 4}, {"\xFF\xD8\xFF", 3}, {"II*\0", 4}, {"MM\0*", 4}, {"BM", 2}, {"P4", 2}, {"P5", 2}, {"P6", 2}};
+    for (const auto& sig : SIGNATURES) {
+        if (size >= sig.len && memcmp(data, sig.magic, sig.len) == 0) {
+            return cv::imdecode(bytes, cv::IMREAD_UNCHANGED);
+        }
+    }
+
+    if (size < 8) return cv::Mat();
+    int format = data[0] % 3;
+    int cols = std::max(1, (int)(((data[1] << 8) | data[2]) % 256) * 16); // Up to 4080 px
+    int rows = std::max(1, (int)(((data[3] << 8) | data[4]) % 256) * 16);
+    int tile_w = std::max(1, (int)data[5]);
+    g_layout_engine = (data[6] & 1) ? LayoutEngine::XYCut : LayoutEngine::Contours;
+    g_binarizer = (data[6] & 2) ? Binarizer::Sauvola : Binarizer::Gaussian;
+    data += 7;
+    size -= 7;
+
+    int channels = (format == 2) ? 3 : 1;
+    size_t tile_px = size / channels;
+    if (tile_px == 0) return cv::Mat();
+    tile_w = std::min(tile_w, (int)tile_px);
+    int tile_h = (int)(tile_px / tile_w);
+
+    cv::Mat tile(tile_h, tile_w, channels == 3 ? CV_8UC3 : CV_8UC1);
+    memcpy(tile.data, data, tile.total() * channels);
+    if (format == 0) cv::threshold(tile, tile, 127, 255, cv::THRESH_BINARY);
+
+    cv::Mat page;
+    cv::repeat(tile, rows / tile_h + 1, cols / tile_w + 1, page);
+    return page(cv::Rect(0, 0, cols, rows)).clone();
+}
+
+static void run_page(const uint8_t* data, size_t size) {
+    static tesseract::TessBaseAPI* tess = (env_long("DOCIMG_FUZZ_OCR", 0) && support_TESSERACT)
+                                              ? create_tesseract() : nullptr;
+    cv::Mat image = page_from_input(data, size);
+    if (image.empty()) return;
+    PixelFormat format = classify_pixel_format(image);
+    extractFigures(image, format, tess, tess != nullptr);
+}
+
+static void run_placement_parser(const uint8_t* data, size_t size) {
+    std::istringstream xml(std::string((const char*)data, size));
+    parse_placed_images(xml, "/nonexistent");
+}
+
+static void run_filename_parser(const uint8_t* data, size_t size) {
+    page_number_from_filename(std::string((const char*)data, size));
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+    // Detection runs in-process; the application's feature probes are not needed
+    support_OPENCV = true;
+    support_TESSERACT = true;
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 1) return 0;
+    static const long limit_ms = env_long("DOCIMG_FUZZ_PAGE_MS", 2000);
+    static const long limit_mb = env_long("DOCIMG_FUZZ_PAGE_MB", 256);
+
+    int target = data[0] % 3;
+    long rss_before = max_rss_kb();
+    auto start = std::chrono::steady_clock::now();
+
+    if (target == 0) run_page(data + 1, size - 1);
+    else if (target == 1) run_placement_parser(data + 1, size - 1);
+    else run_filename_parser(data + 1, size - 1);
+
+    double ms = elapsed_ns(start) / 1e6;
+    // ru_maxrss only grows, so this flags inputs that raise the high-water mark
+    long mb = (max_rss_kb() - rss_before) >> 10;
+
+    g_cost_counters[target][std::min(15, log2_bucket(ms))]++;
+    g_cost_counters[target][16 + std::min(15, log2_bucket((double)mb))]++;
+
+    if (ms > limit_ms) save_to_corpus(data, size, "slow input", ms, mb);
+    else if (mb > limit_mb) save_to_corpus(data, size, "memory-heavy input", ms, mb);
+    return 0;
+}
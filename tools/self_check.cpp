@@ -0,0 +1,397 @@
+// Self-checks for code whose mistakes do not crash but quietly change the
+// output: layout geometry, thresholds, and what is reused between runs.
+//
+// Each check builds a small synthetic input, runs it through the same code
+// the application uses and compares the result with an answer worked out by
+// hand or by brute force. Failures are printed with file and line; the exit
+// status is the number of failed checks.
+//
+// Build (same libraries as the application and its detection module):
+//   g++ -std=c++17 -O1 -g tools/self_check.cpp -o self_check
+//       `fltk-config --cflags --ldflags` `pkg-config --cflags --libs opencv4`
+//       -ltesseract -llept -lzstd -ldl -lrt -pthread
+// Run:
+//   ./self_check            all checks
+//   ./self_check xycut      only the checks whose name starts with "xycut"
+#define DOCIMG_NO_MAIN
+#include "../main.cpp"
+#include "../cv_engine.cpp" // Linked in directly; the harness does not dlopen it
+#include <random>
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            g_failures++; \
+        } \
+    } while (0)
+
+static std::string rect_text(const cv::Rect& r) {
+    return std::to_string(r.x) + "," + std::to_string(r.y) + " " + std::to_string(r.width) + "x" + std::to_string(r.height);
+}
+
+static bool has_rect(const std::vector<cv::Rect>& boxes, const cv::Rect& want) {
+    return std::find(boxes.begin(), boxes.end(), want) != boxes.end();
+}
+
+// ==========================================
+// XY-cut Layout Engine
+// ==========================================
+// xyCut works on a 0/1 page at reduced scale; these pages are drawn at that
+// scale directly so the expected blocks are exact.
+
+// Text lines 4 rows high with 4-row leading (below the 8-row minimum gap)
+static void draw_lines(cv::Mat& binary, int x0, int x1, int y0, int y1) {
+    for (int y = y0; y + 4 <= y1; y += 8) binary(cv::Rect(x0, y, x1 - x0, 4)).setTo(1);
+}
+
+static void check_xycut_two_columns() {
+    cv::Mat binary = cv::Mat::zeros(200, 200, CV_8UC1);
+    draw_lines(binary, 20, 91, 20, 180);   // Left column, x 20..90
+    draw_lines(binary, 110, 181, 20, 180); // Right column, x 110..180; gutter 19 wide
+
+    std::vector<cv::Rect> blocks;
+    xyCut(binary, cv::Rect(0, 0, binary.cols, binary.rows), 8, 0, blocks);
+
+    for (const auto& b : blocks) std::cout << "  two columns: " << rect_text(b) << std::endl;
+    CHECK(blocks.size() == 2);
+    CHECK(has_rect(blocks, cv::Rect(20, 20, 71, 156)));
+    CHECK(has_rect(blocks, cv::Rect(110, 20, 71, 156)));
+}
+
+static void check_xycut_full_width_figure() {
+    cv::Mat binary = cv::Mat::zeros(200, 200, CV_8UC1);
+    draw_lines(binary, 20, 91, 20, 60);    // Two columns above the figure (rows 20..55)
+    draw_lines(binary, 110, 181, 20, 60);
+    binary(cv::Rect(20, 80, 161, 60)).setTo(1); // Figure across both columns
+    draw_lines(binary, 20, 91, 160, 184);  // Two columns below it (rows 160..179)
+    draw_lines(binary, 110, 181, 160, 184);
+
+    std::vector<cv::Rect> blocks;
+    xyCut(binary, cv::Rect(0, 0, binary.cols, binary.rows), 8, 0, blocks);
+
+    for (const auto& b : blocks) std::cout << "  full-width figure: " << rect_text(b) << std::endl;
+    CHECK(blocks.size() == 5);
+    CHECK(has_rect(blocks, cv::Rect(20, 80, 161, 60))); // The figure is a block of its own
+    CHECK(has_rect(blocks, cv::Rect(20, 20, 71, 36)));
+    CHECK(has_rect(blocks, cv::Rect(110, 20, 71, 36)));
+    CHECK(has_rect(blocks, cv::Rect(20, 160, 71, 20)));
+    CHECK(has_rect(blocks, cv::Rect(110, 160, 71, 20)));
+}
+
+// Same figure page at full resolution through the engine entry point: boxes
+// come back scaled up and still separate the figure from the text
+static void check_xycut_page_scale() {
+    cv::Mat small = cv::Mat::zeros(200, 200, CV_8UC1);
+    draw_lines(small, 20, 91, 20, 60);
+    draw_lines(small, 110, 181, 20, 60);
+    small(cv::Rect(20, 80, 161, 60)).setTo(1);
+    cv::Mat page;
+    cv::resize(small == 0, page, cv::Size(), XYCUT_SCALE, XYCUT_SCALE, cv::INTER_NEAREST); // Black ink on white
+
+    std::vector<cv::Rect> boxes = findCandidateRegionsXYCut<PixelFormat::Gray>(page);
+    for (const auto& b : boxes) std::cout << "  full resolution: " << rect_text(b) << std::endl;
+    CHECK(boxes.size() == 3);
+    CHECK(has_rect(boxes, cv::Rect(20 * XYCUT_SCALE, 80 * XYCUT_SCALE, 161 * XYCUT_SCALE, 60 * XYCUT_SCALE)));
+}
+
+// ==========================================
+// Sauvola Binarisation
+// ==========================================
+
+// Threshold of one pixel from its window, summed directly
+static uchar sauvola_direct(const cv::Mat& gray, int y, int x, int window) {
+    int half = window / 2;
+    int top = std::max(0, y - half), bottom = std::min(gray.rows - 1, y + half);
+    int left = std::max(0, x - half), right = std::min(gray.cols - 1, x + half);
+    long long sum = 0, sq = 0;
+    for (int v = top; v <= bottom; v++) {
+        for (int u = left; u <= right; u++) {
+            int p = gray.at<uchar>(v, u);
+            sum += p;
+            sq += p * p;
+        }
+    }
+    double n = (double)(right - left + 1) * (bottom - top + 1);
+    double mean = sum / n;
+    double var = sq / n - mean * mean;
+    double threshold = mean * (1.0 + SAUVOLA_K * (std::sqrt(std::max(var, 0.0)) / SAUVOLA_R - 1.0));
+    return gray.at<uchar>(y, x) <= threshold ? 255 : 0;
+}
+
+// The running sums must give every pixel the same window as summing it
+// directly, including at the borders and for windows larger than the image
+static void check_sauvola_running_sums() {
+    std::mt19937 rng(20261018);
+    for (cv::Size size : {cv::Size(37, 23), cv::Size(1, 9), cv::Size(64, 64)}) {
+        cv::Mat gray(size, CV_8UC1);
+        for (int y = 0; y < gray.rows; y++) {
+            // A dark band over the top half, so both sides of the threshold occur
+            int range = y < gray.rows / 2 ? 64 : 256;
+            for (int x = 0; x < gray.cols; x++) gray.at<uchar>(y, x) = (uchar)(rng() % range);
+        }
+        for (int window : {1, 3, 4, 5, SAUVOLA_WINDOW, 99}) {
+            cv::Mat binary;
+            sauvolaBinarizeInv(gray, binary, window);
+            int mismatches = 0;
+            for (int y = 0; y < gray.rows; y++) {
+                for (int x = 0; x < gray.cols; x++) {
+                    if (binary.at<uchar>(y, x) != sauvola_direct(gray, y, x, window)) mismatches++;
+                }
+            }
+            if (mismatches) {
+                std::cout << "  " << size.width << "x" << size.height << " window " << window << ": "
+                          << mismatches << " pixels differ" << std::endl;
+            }
+            CHECK(mismatches == 0);
+        }
+    }
+}
+
+// ==========================================
+// PDF Form Placement
+// ==========================================
+
+static void check_pdf_form_draws() {
+    CHECK(!pdf_form_draws("BT /F1 12 Tf 72 700 Td (Caption) Tj ET"));
+    CHECK(!pdf_form_draws("0 0 200 100 re W n BT (Clipped text) Tj ET")); // Clip path only
+    CHECK(!pdf_form_draws("10 10 m 100 100 l n"));                         // Path discarded
+    CHECK(pdf_form_draws("0 0 200 100 re f"));
+    CHECK(pdf_form_draws("10 10 m 100 100 l S"));
+    CHECK(pdf_form_draws("0 0 200 100 re f*"));
+    CHECK(pdf_form_draws("q 200 0 0 100 0 0 cm /Im1 Do Q"));
+    CHECK(pdf_form_draws("/Sh1 sh"));
+    CHECK(pdf_form_draws("BI /W 2 /H 2 /BPC 8 /CS /G ID \x01\x02\x03\x04 EI"));
+    CHECK(!pdf_form_draws("(re f S) Tj")); // Operators inside strings are text
+}
+
+static bool same_box(const PlacedForm& a, const PlacedForm& b) {
+    return a.left == b.left && a.top == b.top && a.width == b.width && a.height == b.height;
+}
+
+// A box near the top-left corner of a 600 x 800 pt portrait page, shown
+// turned clockwise: at 90 it ends up near the top-right of the 800 x 600 view
+static void check_pdf_rotate_box() {
+    PlacedForm box = {10, 20, 100, 50};
+    CHECK(same_box(pdf_rotate_box(box, 0, 600, 800), box));
+    CHECK(same_box(pdf_rotate_box(box, 90, 600, 800), PlacedForm{730, 10, 50, 100}));
+    CHECK(same_box(pdf_rotate_box(box, 180, 600, 800), PlacedForm{490, 730, 100, 50}));
+    CHECK(same_box(pdf_rotate_box(box, 270, 600, 800), PlacedForm{20, 490, 50, 100}));
+    // Turning on by the rest of a full turn brings it back
+    CHECK(same_box(pdf_rotate_box(pdf_rotate_box(box, 90, 600, 800), 270, 800, 600), box));
+}
+
+// ==========================================
+// Page Fingerprints (Incremental Re-runs)
+// ==========================================
+
+struct QdfObject {
+    int id;
+    int page; // Page number for page objects, else 0
+    std::string dict;
+    std::string stream;
+};
+
+// QDF text as qpdf writes it, indexed the way load_qdf does
+static QdfDocument make_qdf(const std::vector<QdfObject>& objects) {
+    QdfDocument qdf;
+    qdf.file = "%PDF-1.3\n%QDF-1.0\n\n";
+    for (const auto& o : objects) {
+        if (o.page) qdf.file += "%% Page " + std::to_string(o.page) + "\n";
+        qdf.file += std::to_string(o.id) + " 0 obj\n" + o.dict + "\n";
+        if (!o.stream.empty()) qdf.file += "stream\n" + o.stream + "\nendstream\n";
+        qdf.file += "endobj\n\n";
+    }
+    CHECK(index_qdf(qdf));
+    return qdf;
+}
+
+static QdfObject content_object(int id, const std::string& text) {
+    std::string stream = "BT /F1 12 Tf 72 720 Td (" + text + ") Tj ET";
+    return {id, 0, "<< /Length " + std::to_string(stream.size()) + " >>", stream};
+}
+
+// Edition A: three pages inheriting MediaBox and fonts, a note on page 2
+static QdfDocument edition_a() {
+    return make_qdf({
+        {1, 0, "<< /Type /Catalog /Pages 2 0 R >>", ""},
+        {2, 0, "<< /Type /Pages /Kids [ 3 0 R 4 0 R 5 0 R ] /Count 3 /MediaBox [ 0 0 612 792 ] "
+               "/Resources << /Font << /F1 10 0 R >> >> >>", ""},
+        {3, 1, "<< /Type /Page /Parent 2 0 R /Contents 6 0 R >>", ""},
+        {4, 2, "<< /Type /Page /Parent 2 0 R /Contents 7 0 R /Annots [ 9 0 R ] >>", ""},
+        {5, 3, "<< /Type /Page /Parent 2 0 R /Contents 8 0 R >>", ""},
+        content_object(6, "Introduction"),
+        content_object(7, "Results"),
+        content_object(8, "Discussion"),
+        {9, 0, "<< /Type /Annot /Subtype /Text /P 4 0 R /Rect [ 72 700 92 720 ] /Contents (Check this) >>", ""},
+        {10, 0, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>", ""},
+    });
+}
+
+// Edition B, renumbered throughout: an erratum page first, the note on
+// Results answered, Discussion given a transparency group. Page text is
+// unchanged, so only the annotation and the group tell the pages apart.
+static QdfDocument edition_b() {
+    return make_qdf({
+        {1, 0, "<< /Type /Catalog /Pages 2 0 R >>", ""},
+        {2, 0, "<< /Type /Pages /Kids [ 20 0 R 13 0 R 14 0 R 15 0 R ] /Count 4 /MediaBox [ 0 0 612 792 ] "
+               "/Resources << /Font << /F1 30 0 R >> >> >>", ""},
+        {20, 1, "<< /Type /Page /Parent 2 0 R /Contents 21 0 R >>", ""},
+        {13, 2, "<< /Type /Page /Parent 2 0 R /Contents 16 0 R >>", ""},
+        {14, 3, "<< /Type /Page /Parent 2 0 R /Contents 17 0 R /Annots [ 19 0 R ] >>", ""},
+        {15, 4, "<< /Type /Page /Parent 2 0 R /Contents 18 0 R /Group << /S /Transparency /CS /DeviceRGB >> >>", ""},
+        content_object(16, "Introduction"),
+        content_object(17, "Results"),
+        content_object(18, "Discussion"),
+        {19, 0, "<< /Type /Annot /Subtype /Text /P 14 0 R /Rect [ 72 700 92 720 ] /Contents (Checked) >>", ""},
+        content_object(21, "Erratum"),
+        {30, 0, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>", ""},
+    });
+}
+
+static void write_text(const std::string& path, const std::string& text) {
+    std::ofstream(path, std::ios::binary) << text;
+}
+
+static bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static void check_pdf_page_fingerprints() {
+    std::vector<std::string> a = pdf_page_fingerprints(edition_a());
+    std::vector<std::string> b = pdf_page_fingerprints(edition_b());
+    CHECK(a.size() == 3);
+    CHECK(b.size() == 4);
+    if (a.size() != 3 || b.size() != 4) return;
+
+    CHECK(std::find(a.begin(), a.end(), b[0]) == a.end()); // New page
+    CHECK(b[1] == a[0]);                                    // Moved, object numbers changed
+    CHECK(b[2] != a[1]);                                    // Annotation changed
+    CHECK(b[3] != a[2]);                                    // Transparency group added
+}
+
+// Outputs of edition A in a scratch folder, then edition B planned over them:
+// only the pages whose fingerprint is new are rendered again, and the moved
+// page keeps its earlier outputs under its new name
+static void check_incremental_run() {
+    std::vector<std::string> a = pdf_page_fingerprints(edition_a());
+    std::vector<std::string> b = pdf_page_fingerprints(edition_b());
+    if (a.size() != 3 || b.size() != 4) {
+        CHECK(!"fixtures did not fingerprint");
+        return;
+    }
+
+    char scratch[] = "/tmp/docimg_self_check_XXXXXX";
+    if (!mkdtemp(scratch)) {
+        CHECK(!"mkdtemp failed");
+        return;
+    }
+    std::string folder = scratch;
+    mkdir((folder + "/opencv_figures").c_str(), 0777);
+
+    IncrementalRun first;
+    first.folder = folder;
+    first.fingerprints = a;
+    for (int page = 1; page <= 3; page++) {
+        std::string name = rendered_page_name("pdf", page, 3);
+        first.names.push_back(name);
+        write_text(folder + "/" + name + ".png", "A" + std::to_string(page));
+        write_text(folder + "/opencv_figures/" + name + "_figure_1.png", "A" + std::to_string(page) + " figure");
+    }
+    first.finish();
+
+    IncrementalRun second;
+    second.plan(folder, "pdf", b, 4);
+    CHECK(second.todo == std::vector<bool>({false, true, false, true, true}));
+    CHECK(!exists(folder + "/page-1.png")); // Earlier outputs cleared before rendering
+    CHECK(!exists(folder + "/page-3.png"));
+
+    for (int page = 1; page <= 4; page++) {
+        if (page < (int)second.todo.size() && !second.todo[page]) continue;
+        write_text(folder + "/" + rendered_page_name("pdf", page, 4) + ".png", "B" + std::to_string(page));
+    }
+    second.finish();
+
+    CHECK(read_file(folder + "/page-1.png") == "B1");
+    CHECK(read_file(folder + "/page-2.png") == "A1");
+    CHECK(read_file(folder + "/opencv_figures/page-2_figure_1.png") == "A1 figure");
+    CHECK(read_file(folder + "/page-3.png") == "B3");
+    CHECK(!exists(folder + "/opencv_figures/page-3_figure_1.png")); // Stale figure of the old page 3
+    CHECK(!exists(folder + "/" + REUSED_PAGES_DIR));
+
+    // The same edition again: nothing left to render
+    IncrementalRun third;
+    third.plan(folder, "pdf", b, 4);
+    CHECK(third.todo == std::vector<bool>({false, false, false, false, false}));
+    third.finish();
+
+    std::string rm = "rm -rf '" + folder + "'";
+    run_command(rm.c_str());
+}
+
+// ==========================================
+// Cross-Run Duplicate Index
+// ==========================================
+
+static void check_bktree_threshold() {
+    const uint64_t base = 0x0123456789abcdefULL;
+    auto flip = [](uint64_t h, int bits) {
+        for (int i = 0; i < bits; i++) h ^= 1ULL << (i * 9 % 64);
+        return h;
+    };
+
+    BkTree tree;
+    tree.insert(base, "a/figure.png");
+    tree.insert(~base, "b/figure.png"); // Far from everything queried below
+
+    const BkTree::Node* at = tree.find(flip(base, PHASH_MAX_DISTANCE), PHASH_MAX_DISTANCE);
+    CHECK(at && at->path == "a/figure.png");
+    CHECK(tree.find(flip(base, PHASH_MAX_DISTANCE + 1), PHASH_MAX_DISTANCE) == nullptr);
+
+    // Entries inserted after the first are reached through the tree too
+    BkTree reversed;
+    reversed.insert(~base, "b/figure.png");
+    reversed.insert(base, "a/figure.png");
+    at = reversed.find(flip(base, PHASH_MAX_DISTANCE), PHASH_MAX_DISTANCE);
+    CHECK(at && at->path == "a/figure.png");
+    CHECK(reversed.find(flip(base, PHASH_MAX_DISTANCE + 1), PHASH_MAX_DISTANCE) == nullptr);
+
+    // No hash: never stored, never found, even next to a stored hash 1 bit away
+    BkTree zero;
+    zero.insert(0, "tiny/figure.png");
+    CHECK(zero.nodes.empty());
+    zero.insert(1, "one/figure.png");
+    CHECK(zero.find(0, PHASH_MAX_DISTANCE) == nullptr);
+    CHECK(perceptual_hash(cv::Mat(16, 16, CV_8UC1, cv::Scalar(128))) == 0); // Too small to hash
+}
+
+// ==========================================
+// Runner
+// ==========================================
+
+int main(int argc, char** argv) {
+    static const struct { const char* name; void (*fn)(); } CHECKS[] = {
+        {"xycut_two_columns", check_xycut_two_columns},
+        {"xycut_full_width_figure", check_xycut_full_width_figure},
+        {"xycut_page_scale", check_xycut_page_scale},
+        {"sauvola_running_sums", check_sauvola_running_sums},
+        {"pdf_form_draws", check_pdf_form_draws},
+        {"pdf_rotate_box", check_pdf_rotate_box},
+        {"pdf_page_fingerprints", check_pdf_page_fingerprints},
+        {"incremental_run", check_incremental_run},
+        {"bktree_threshold", check_bktree_threshold},
+    };
+    std::string only = argc > 1 ? argv[1] : "";
+    for (const auto& check : CHECKS) {
+        if (std::string(check.name).compare(0, only.size(), only) != 0) continue;
+        int before = g_failures;
+        std::cout << check.name << std::endl;
+        check.fn();
+        std::cout << (g_failures == before ? "  ok" : "  FAILED") << std::endl;
+    }
+    std::cout << (g_failures ? std::to_string(g_failures) + " check(s) failed" : std::string("all checks passed")) << std::endl;
+    return g_failures;
+}
@@ -0,0 +1,385 @@
+// Trace-replay scheduling simulator.
+//
+// Replays a run recorded with DOCIMG_TRACE=<file> (one JSON line per render
+// or detect task) in a discrete-event simulation under a different policy,
+// and predicts makespan, worker utilisation and peak page memory.
+//
+// Build: g++ -std=c++17 -O2 tools/trace_sim.cpp -o trace_sim
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <set>
+#include <functional>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+// ==========================================
+// Trace Loading
+// ==========================================
+
+struct Task {
+    int doc;
+    bool render;       // Otherwise detect
+    int page;
+    double dur;
+    size_t bytes;
+    std::vector<int> deps;
+    std::vector<int> dependents;
+};
+
+struct Trace {
+    std::vector<std::string> docs;
+    std::vector<Task> tasks;
+    double recorded_makespan = 0;
+};
+
+// Position just past "key": (whitespace allowed), or npos
+static size_t json_value(const std::string& line, const std::string& key) {
+    size_t pos = line.find("\"" + key + "\"");
+    if (pos == std::string::npos) return pos;
+    pos += key.size() + 2;
+    while (pos < line.size() && (line[pos] == ' ' || line[pos] == ':')) pos++;
+    return pos;
+}
+
+static std::string json_string(const std::string& line, const std::string& key) {
+    size_t pos = json_value(line, key);
+    if (pos == std::string::npos || pos >= line.size() || line[pos] != '"') return "";
+    std::string out;
+    for (pos++; pos < line.size() && line[pos] != '"'; pos++) {
+        if (line[pos] == '\\' && pos + 1 < line.size()) pos++;
+        out += line[pos];
+    }
+    return out;
+}
+
+static double json_number(const std::string& line, const std::string& key) {
+    size_t pos = json_value(line, key);
+    if (pos == std::string::npos) return 0;
+    return atof(line.c_str() + pos);
+}
+
+bool load_trace(const std::string& path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::map<std::string, int> doc_index;
+    std::vector<double> doc_first_start;
+    double first = 1e300, last = 0;
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        std::string doc = json_string(line, "doc");
+        double start = json_number(line, "start");
+        double dur = json_number(line, "dur");
+
+        auto it = doc_index.find(doc);
+        if (it == doc_index.end()) {
+            it = doc_index.emplace(doc, (int)trace.docs.size()).first;
+            trace.docs.push_back(doc);
+            doc_first_start.push_back(start);
+        }
+        doc_first_start[it->second] = std::min(doc_first_start[it->second], start);
+
+        Task t;
+        t.doc = it->second;
+        t.render = json_string(line, "stage") == "render";
+        t.page = (int)json_number(line, "page");
+        t.dur = dur;
+        t.bytes = (size_t)json_number(line, "bytes");
+        trace.tasks.push_back(t);
+
+        first = std::min(first, start);
+        last = std::max(last, start + dur);
+    }
+    if (trace.tasks.empty()) return false;
+    trace.recorded_makespan = last - first;
+
+    // Renumber documents in the order the run started them
+    std::vector<int> order(trace.docs.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return doc_first_start[a] < doc_first_start[b]; });
+    std::vector<int> rank(order.size());
+    std::vector<std::string> docs(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        rank[order[i]] = (int)i;
+        docs[i] = trace.docs[order[i]];
+    }
+    trace.docs = docs;
+    for (auto& t : trace.tasks) t.doc = rank[t.doc];
+    return true;
+}
+
+// ==========================================
+// Policy & Simulation
+// ==========================================
+
+struct Policy {
+    int render_workers = 0;   // 0 = use the shared pool
+    int detect_workers = 0;
+    int shared_workers = 0;   // > 0: one pool runs both stages
+    bool lpt = false;         // Longest task first instead of FIFO
+    bool overlap = false;     // Detect a page as soon as it is rendered (else after the whole document)
+    bool sequential_docs = true;
+    double memory_mb = 0;     // Budget for rendered-but-undetected pages (0 = unlimited)
+};
+
+struct Result {
+    double makespan = 0;
+    double render_busy = 0;
+    double detect_busy = 0;
+    double peak_memory = 0;
+    bool deadlock = false;
+};
+
+// Detect tasks depend on the render of their page (overlap) or on every
+// render of their document (barrier, as the tool runs today). Pages numbered
+// 0 are images extracted without rendering and always wait for the document.
+static void build_dependencies(std::vector<Task>& tasks, bool overlap) {
+    std::map<std::pair<int, int>, int> render_of;
+    std::map<int, std::vector<int>> renders_of_doc;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        tasks[i].deps.clear();
+        tasks[i].dependents.clear();
+        if (tasks[i].render) {
+            render_of[{tasks[i].doc, tasks[i].page}] = (int)i;
+            renders_of_doc[tasks[i].doc].push_back((int)i);
+        }
+    }
+    for (size_t i = 0; i < tasks.size(); i++) {
+        Task& t = tasks[i];
+        if (t.render) continue;
+        auto own = render_of.find({t.doc, t.page});
+        if (overlap && t.page > 0 && own != render_of.end()) {
+            t.deps.push_back(own->second);
+        } else {
+            t.deps = renders_of_doc[t.doc];
+        }
+        for (int d : t.deps) tasks[d].dependents.push_back((int)i);
+    }
+
+    // A render holds its page until the detect that consumes it finishes
+    for (auto& t : tasks) {
+        if (!t.render || t.bytes > 0) continue;
+        for (int d : t.dependents) {
+            if (tasks[d].page == t.page) t.bytes = tasks[d].bytes;
+        }
+    }
+}
+
+Result simulate(const Trace& trace, const Policy& policy) {
+    std::vector<Task> tasks = trace.tasks;
+    build_dependencies(tasks, policy.overlap);
+
+    size_t n = tasks.size();
+    int docs = (int)trace.docs.size();
+    std::vector<int> pending_deps(n);
+    std::vector<int> doc_remaining(docs, 0);
+    for (size_t i = 0; i < n; i++) {
+        pending_deps[i] = (int)tasks[i].deps.size();
+        doc_remaining[tasks[i].doc]++;
+    }
+
+    // Memory held by a rendered page until its consumers finish
+    std::vector<int> consumers_left(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (tasks[i].render) consumers_left[i] = (int)tasks[i].dependents.size();
+    }
+
+    bool shared = policy.shared_workers > 0;
+    int free_render = shared ? policy.shared_workers : policy.render_workers;
+    int free_detect = shared ? 0 : policy.detect_workers;
+    double budget = policy.memory_mb * 1024.0 * 1024.0;
+    double held = 0;
+    int current_doc = 0;
+
+    // Ready tasks in dispatch order, one queue per worker pool. Tasks enter
+    // when their last dependency finishes, so each event only looks at the
+    // heads of the queues. With sequential documents the document comes
+    // first, so the current one's tasks lead.
+    auto before = [&](int a, int b) {
+        const Task& x = tasks[a];
+        const Task& y = tasks[b];
+        if (policy.sequential_docs && x.doc != y.doc) return x.doc < y.doc;
+        if (policy.lpt) {
+            if (x.dur != y.dur) return x.dur > y.dur;
+        } else {
+            if (x.doc != y.doc) return x.doc < y.doc;
+            if (x.render != y.render) return x.render;
+            if (x.page != y.page) return x.page < y.page;
+        }
+        return a < b;
+    };
+    typedef std::set<int, std::function<bool(int, int)>> ReadyQueue;
+    ReadyQueue ready[2] = {ReadyQueue(before), ReadyQueue(before)}; // Render (or shared) pool, detect pool
+    auto make_ready = [&](int i) { ready[(shared || tasks[i].render) ? 0 : 1].insert(i); };
+    for (size_t i = 0; i < n; i++) {
+        if (pending_deps[i] == 0) make_ready((int)i);
+    }
+
+    typedef std::pair<double, int> Event; // End time, task
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> running;
+    Result r;
+    double now = 0;
+    size_t done = 0;
+
+    auto dispatch = [&]() {
+        for (int k = 0; k < 2; k++) {
+            int& pool = (k == 0) ? free_render : free_detect;
+            for (auto it = ready[k].begin(); it != ready[k].end() && pool > 0;) {
+                int i = *it;
+                Task& t = tasks[i];
+                if (policy.sequential_docs && t.doc != current_doc) break;
+                if (t.render && budget > 0 && held > 0 && held + t.bytes > budget) {
+                    ++it;
+                    continue;
+                }
+                pool--;
+                if (t.render) held += t.bytes;
+                r.peak_memory = std::max(r.peak_memory, held);
+                running.push({now + t.dur, i});
+                it = ready[k].erase(it);
+            }
+        }
+    };
+
+    dispatch();
+    while (!running.empty()) {
+        Event e = running.top();
+        running.pop();
+        now = e.first;
+        Task& t = tasks[e.second];
+        (t.render ? r.render_busy : r.detect_busy) += t.dur;
+        ((shared || t.render) ? free_render : free_detect)++;
+        done++;
+
+        for (int d : t.dependents) {
+            if (--pending_deps[d] == 0) make_ready(d);
+        }
+        if (!t.render) {
+            for (int dep : t.deps) {
+                if (--consumers_left[dep] == 0) held -= tasks[dep].bytes;
+            }
+        } else if (consumers_left[e.second] == 0) {
+            held -= t.bytes;
+        }
+
+        if (--doc_remaining[t.doc] == 0) {
+            while (current_doc < docs && doc_remaining[current_doc] == 0) current_doc++;
+        }
+        dispatch();
+    }
+
+    r.makespan = now;
+    r.deadlock = done < n;
+    return r;
+}
+
+// ==========================================
+// Main
+// ==========================================
+
+static void print_result(const Policy& p, const Result& r) {
+    bool shared = p.shared_workers > 0;
+    double render_cap = (shared ? p.shared_workers : p.render_workers) * r.makespan;
+    double detect_cap = (shared ? p.shared_workers : p.detect_workers) * r.makespan;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "makespan " << r.makespan << " s";
+    if (shared) {
+        std::cout << ", utilisation " << 100.0 * (r.render_busy + r.detect_busy) / std::max(1e-9, render_cap) << "%";
+    } else {
+        std::cout << ", render utilisation " << 100.0 * r.render_busy / std::max(1e-9, render_cap) << "%"
+                  << ", detect utilisation " << 100.0 * r.detect_busy / std::max(1e-9, detect_cap) << "%";
+    }
+    std::cout << ", peak page memory " << r.peak_memory / (1024.0 * 1024.0) << " MB";
+    if (r.deadlock) std::cout << " (did not finish: memory budget too small; barrier mode holds a whole document)";
+    std::cout << std::endl;
+}
+
+static void usage() {
+    std::cerr << "Usage: trace_sim TRACE.jsonl [options]\n"
+                 "  --render N         render workers (default 4)\n"
+                 "  --detect N         detect workers (default 4)\n"
+                 "  --shared N         one pool of N workers for both stages\n"
+                 "  --order fifo|lpt   dispatch order among ready tasks (default fifo)\n"
+                 "  --pipeline barrier|overlap\n"
+                 "                     detect after the whole document is rendered (default),\n"
+                 "                     or each page as soon as it is rendered\n"
+                 "  --docs sequential|interleaved\n"
+                 "                     one document at a time (default), or all at once\n"
+                 "  --memory-mb N      budget for rendered pages awaiting detection\n"
+                 "  --sweep MAX        try every render/detect split up to MAX workers each\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    Policy policy;
+    policy.render_workers = 4;
+    policy.detect_workers = 4;
+    int sweep = 0;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : "";
+        if (arg == "--render") { policy.render_workers = atoi(val); i++; }
+        else if (arg == "--detect") { policy.detect_workers = atoi(val); i++; }
+        else if (arg == "--shared") { policy.shared_workers = atoi(val); i++; }
+        else if (arg == "--order") { policy.lpt = strcmp(val, "lpt") == 0; i++; }
+        else if (arg == "--pipeline") { policy.overlap = strcmp(val, "overlap") == 0; i++; }
+        else if (arg == "--docs") { policy.sequential_docs = strcmp(val, "interleaved") != 0; i++; }
+        else if (arg == "--memory-mb") { policy.memory_mb = atof(val); i++; }
+        else if (arg == "--sweep") { sweep = atoi(val); i++; }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    Trace trace;
+    if (!load_trace(argv[1], trace)) {
+        std::cerr << "Could not read any tasks from " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::cout << trace.tasks.size() << " tasks in " << trace.docs.size() << " document(s), recorded makespan "
+              << std::fixed << std::setprecision(2) << trace.recorded_makespan << " s" << std::endl;
+
+    if (sweep > 0) {
+        std::vector<std::pair<double, std::pair<int, int>>> results;
+        for (int rw = 1; rw <= sweep; rw++) {
+            for (int dw = 1; dw <= sweep; dw++) {
+                Policy p = policy;
+                p.shared_workers = 0;
+                p.render_workers = rw;
+                p.detect_workers = dw;
+                Result r = simulate(trace, p);
+                if (!r.deadlock) results.push_back({r.makespan, {rw, dw}});
+            }
+        }
+        std::sort(results.begin(), results.end());
+        std::cout << "Best render/detect splits:" << std::endl;
+        for (size_t i = 0; i < results.size() && i < 5; i++) {
+            Policy p = policy;
+            p.shared_workers = 0;
+            p.render_workers = results[i].second.first;
+            p.detect_workers = results[i].second.second;
+            std::cout << "  render " << p.render_workers << ", detect " << p.detect_workers << ": ";
+            print_result(p, simulate(trace, p));
+        }
+        return 0;
+    }
+
+    print_result(policy, simulate(trace, policy));
+    return 0;
+}